@@ -14,10 +14,16 @@
 
 #include "SDLContext.h"
 #include "core/GameBoy.h"
+#include "core/RomIndex.h"
+#include "core/RomFile.h"
+#include "core/memory/MemoryBus.h"
 
+#include "common/Hash.h"
 #include "common/Types.h"
 
+#include <chrono>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -25,8 +31,262 @@
 #include <stdexcept>
 
 
+// One address of --watch=<hex>[-<hex>],
+// throws std::invalid_argument with the usage
+static u16 ParseWatchAddress(const std::string& hex)
+{
+    size_t length = 0;
+    unsigned long address = 0;
+    try {
+        address = std::stoul(hex, &length, 16);
+    }
+    catch(std::exception& e) {
+        length = 0;
+    }
+    if(length == 0 || length != hex.length() || address > 0xFFFF)
+        throw std::invalid_argument("Usage:\n--watch=<hex>[-<hex>]");
+    return address;
+}
+
+// A count argument (frames, threads), which has
+// to be a positive number
+static bool ParseCount(const std::string& arg, int& count)
+{
+    size_t length = 0;
+    try {
+        count = std::stoi(arg, &length);
+    }
+    catch(std::exception& e) {
+        return false;
+    }
+    return length == arg.length() && count > 0;
+}
+
+// jaxboy --index <rom directory> <index file> [--threads=<n>]
+static int BuildIndex(int argc, char* argv[])
+{
+    // 0 picks one per core
+    int threads = 0;
+    bool valid = (argc == 4 || argc == 5);
+    if(valid && argc == 5)
+    {
+        std::string arg (argv[4]);
+        valid = arg.substr(0, 10) == "--threads=" && ParseCount(arg.substr(10), threads);
+    }
+    if(!valid)
+    {
+        std::cerr << "Usage: --index <rom directory> <index file> [--threads=<n>]\n";
+        return -1;
+    }
+
+    try
+    {
+        u32 count = Core::RomIndex::Build(argv[2], argv[3], threads);
+        std::cout << "Indexed " << count << " roms\n";
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << e.what() << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Seconds to emulate frames frames of rom, headless
+template<typename Timing>
+static double TimeFrames(const std::vector<u8>& rom, int frames)
+{
+    std::vector<u8> bootrom (0x100);
+    Core::GameBoy::Options options;
+    options.skip_bootrom = true;
+    options.framelimiter_hack = false;
+    options.pixel_fifo = Timing::PIXEL_FIFO;
+
+    std::unique_ptr<Core::GameBoy> gameboy (new Core::GameBoy(options, 160, 144, rom, bootrom));
+    u64 cycles = static_cast<u64>(frames) * Core::PPU::FRAME_CYCLES;
+    auto start = std::chrono::steady_clock::now();
+    while(!gameboy->IsStopped() && gameboy->GetCycles() < cycles)
+        gameboy->Cycle<Timing>();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    return time.count();
+}
+
+// jaxboy --bench <frames> <rom>...
+// Compares the PPU timings on each rom
+static int Benchmark(int argc, char* argv[])
+{
+    int frames = 0;
+    if(argc < 4 || !ParseCount(argv[2], frames))
+    {
+        std::cerr << "Usage: --bench <frames> <rom>...\n";
+        return -1;
+    }
+
+    std::cout << std::left << std::setw(40) << "rom"
+              << std::right << std::setw(14) << "scanline ms" << std::setw(14) << "fifo ms"
+              << std::setw(10) << "cost" << "\n";
+    for(int i = 3; i < argc; i++)
+    {
+        std::vector<u8> rom;
+        double scanline, fifo;
+        try
+        {
+            Core::RomFile::Load(argv[i], rom);
+            scanline = TimeFrames<Core::ScanlineTiming>(rom, frames);
+            fifo = TimeFrames<Core::FifoTiming>(rom, frames);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << argv[i] << ": " << e.what() << "\n";
+            continue;
+        }
+        // per frame
+        std::cout << std::left << std::setw(40) << argv[i] << std::right << std::fixed
+                  << std::setprecision(3)
+                  << std::setw(14) << (scanline * 1000 / frames)
+                  << std::setw(14) << (fifo * 1000 / frames)
+                  << std::setprecision(1)
+                  << std::setw(9) << ((fifo / scanline - 1) * 100) << "%\n";
+    }
+    return 0;
+}
+
+// A hash of each of the first frames frames rom draws. Gives up
+// after twice as long as they should take, i.e. if the LCD is off
+template<typename Timing>
+static std::vector<u64> HashFrames(const std::vector<u8>& rom, int frames,
+                                   bool indexed, bool threaded)
+{
+    std::vector<u8> bootrom (0x100);
+    Core::GameBoy::Options options;
+    options.skip_bootrom = true;
+    options.framelimiter_hack = false;
+    // every frame has to be drawn to compare them all
+    options.auto_frameskip = false;
+    options.indexed_framebuffer = indexed;
+    options.render_thread = threaded;
+    options.pixel_fifo = Timing::PIXEL_FIFO;
+
+    std::unique_ptr<Core::GameBoy> gameboy (new Core::GameBoy(options, 160, 144, rom, bootrom));
+    Core::PPU* ppu = gameboy->GetPPU().get();
+    std::vector<u64> hashes;
+    u64 published = 0;
+    u64 cycles = 2 * static_cast<u64>(frames) * Core::PPU::FRAME_CYCLES;
+    while(!gameboy->IsStopped() && hashes.size() < static_cast<size_t>(frames) &&
+          gameboy->GetCycles() < cycles)
+    {
+        gameboy->Cycle<Timing>();
+        if(ppu->GetPublishedFrames() == published)
+            continue;
+        published = ppu->GetPublishedFrames();
+
+        // the frame might still be being drawn on the render thread
+        ppu->FinishRendering();
+        u64 hash = gHashSeed;
+        if(indexed && ppu->GetIndexedFrames().Acquire())
+        {
+            const std::vector<u8>& pixels = ppu->GetIndexedFrames().GetFront().pixels;
+            hash = HashBytes(pixels.data(), pixels.size());
+        }
+        else if(!indexed && ppu->GetFrames().Acquire())
+        {
+            const std::vector<Color>& pixels = ppu->GetFrames().GetFront().pixels;
+            hash = HashBytes(pixels.data(), pixels.size() * sizeof(Color));
+        }
+        hashes.push_back(hash);
+    }
+    return hashes;
+}
+
+// jaxboy --check-render <frames> <rom>...
+// Checks the render thread draws the same frames as drawing
+// inline, for both framebuffer modes. The hash of all the frames
+// can be compared between builds to check a renderer change
+static int CheckRender(int argc, char* argv[])
+{
+    int frames = 0;
+    if(argc < 4 || !ParseCount(argv[2], frames))
+    {
+        std::cerr << "Usage: --check-render <frames> <rom>...\n";
+        return -1;
+    }
+
+    int failed = 0;
+    for(int i = 3; i < argc; i++)
+    {
+        std::vector<u8> rom;
+        try
+        {
+            Core::RomFile::Load(argv[i], rom);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << argv[i] << ": " << e.what() << "\n";
+            failed++;
+            continue;
+        }
+        for(bool indexed : { false, true })
+        {
+            std::vector<u64> inline_hashes = HashFrames<Core::ScanlineTiming>(rom, frames, indexed, false);
+            std::vector<u64> thread_hashes = HashFrames<Core::ScanlineTiming>(rom, frames, indexed, true);
+            u64 hash = HashBytes(inline_hashes.data(), inline_hashes.size() * sizeof(u64));
+
+            std::cout << std::left << std::setw(40) << argv[i]
+                      << std::setw(9) << (indexed? "indexed" : "color")
+                      << std::right << std::setw(6) << inline_hashes.size() << " frames  "
+                      << std::hex << std::setfill('0') << std::setw(16) << hash
+                      << std::dec << std::setfill(' ') << "  ";
+            if(inline_hashes == thread_hashes)
+            {
+                std::cout << "threaded matches\n";
+                continue;
+            }
+            size_t frame = 0;
+            while(frame < inline_hashes.size() && frame < thread_hashes.size() &&
+                  inline_hashes[frame] == thread_hashes[frame])
+                frame++;
+            std::cout << "threaded differs from frame " << frame << "\n";
+            failed++;
+        }
+    }
+    return failed? -1 : 0;
+}
+
+// The main thread's emulation loop
+template<typename Timing>
+static void Run(Core::GameBoy* gameboy, FrontEnd::SDLContext* sdl_context)
+{
+    // Events are polled on a timer rather than per presented
+    // frame, since no frames come while the LCD is off.
+    // The clock is only read every POLL_CHECK instructions
+    const int POLL_CHECK = 1024;
+    const std::chrono::milliseconds POLL_INTERVAL (16);
+    auto next_poll = std::chrono::steady_clock::now();
+    int instructions = 0;
+    while(!gameboy->IsStopped() && !sdl_context->IsStopped())
+    {
+        gameboy->Cycle<Timing>();
+
+        if(++instructions < POLL_CHECK)
+            continue;
+        instructions = 0;
+        auto now = std::chrono::steady_clock::now();
+        if(now >= next_poll) {
+            sdl_context->PollEvents(gameboy);
+            next_poll = now + POLL_INTERVAL;
+        }
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    if(argc > 1 && std::string(argv[1]) == "--index")
+        return BuildIndex(argc, argv);
+    if(argc > 1 && std::string(argv[1]) == "--bench")
+        return Benchmark(argc, argv);
+    if(argc > 1 && std::string(argv[1]) == "--check-render")
+        return CheckRender(argc, argv);
+
     if(argc < 3)
     {
         std::cerr << "Insufficient arguments!\n";
@@ -36,9 +296,9 @@ int main(int argc, char* argv[])
     std::string rom_path (argv[1]);
     std::string bootrom_path (argv[2]);
 
-    if(rom_path.substr(rom_path.length() - 3) != ".gb")
+    if(!Core::RomFile::IsRomPath(rom_path))
     {
-        // not a DMG rom
+        // not a DMG rom (or a compressed one)
         std::cerr << "Not a GameBoy rom!\n";
         return -1;
     }
@@ -52,21 +312,14 @@ int main(int argc, char* argv[])
     std::vector<u8> rom;
     std::vector<u8> bootrom;
 
-    // read ROM
-    std::ifstream rom_file (rom_path, std::ios::binary | std::ios::ate);
-    if(rom_file.good())
+    // read ROM, decompressing it if needed
+    try
     {
-        rom_file.seekg(0, std::ios_base::end);
-        const int rom_size = rom_file.tellg();
-        rom_file.seekg(0, std::ios_base::beg);
-        // allocate rom_size bytes for the rom vector
-        rom.resize(rom_size);
-        rom_file.read(reinterpret_cast<char*>(rom.data()), rom_size);
-        rom_file.close();
+        Core::RomFile::Load(rom_path, rom);
     }
-    else
+    catch(std::runtime_error& e)
     {
-        std::cerr << "Error opening ROM!\n";
+        std::cerr << e.what() << "\n";
         return -1;
     }
 
@@ -95,6 +348,15 @@ int main(int argc, char* argv[])
 
     // Setup system options
     Core::GameBoy::Options options;
+    // Battery backed RAM goes next to the ROM
+    options.save_path = Core::RomFile::StripExtension(rom_path) + ".sav";
+    // Only worth it with a spare core to draw on
+    options.render_thread = std::thread::hardware_concurrency() > 1;
+    // Address ranges to log accesses to
+    std::vector<std::pair<u16, u16>> watches;
+    // File to dump the memory access heatmap to
+    std::string heatmap_path;
+    std::vector<std::string> cheats;
 
     if(argc > 3)
     {
@@ -132,12 +394,73 @@ int main(int argc, char* argv[])
                     options.force_mbc = std::stoi(arg.substr(12));
                 }
                 ///////////////////////
+                // --watch=<hex>[-<hex>]
+                ///////////////////////
+                else if(arg.substr(0, 7) == "--watch") {
+                    if(arg.length() < 8)
+                        throw std::invalid_argument("Usage:\n--watch=<hex>[-<hex>]");
+                    std::string range = arg.substr(8);
+                    size_t dash = range.find('-');
+                    u16 start = ParseWatchAddress(range.substr(0, dash));
+                    u16 end = (dash == std::string::npos)?
+                        start : ParseWatchAddress(range.substr(dash + 1));
+                    if(start > end)
+                        throw std::invalid_argument("Usage:\n--watch=<hex>[-<hex>]");
+                    watches.push_back(std::make_pair(start, end));
+                }
+                ///////////////////////
+                // --heatmap=<file>
+                ///////////////////////
+                else if(arg.substr(0, 9) == "--heatmap") {
+                    if(arg.length() < 10)
+                        throw std::invalid_argument("Usage:\n--heatmap=<file>");
+                    heatmap_path = arg.substr(10);
+                }
+                ///////////////////////
+                // --cheat=<code>
+                ///////////////////////
+                else if(arg.substr(0, 7) == "--cheat") {
+                    if(arg.length() < 8)
+                        throw std::invalid_argument("Usage:\n--cheat=<code>");
+                    cheats.push_back(arg.substr(8));
+                }
+                ///////////////////////
+                // --rtc-host-clock
+                ///////////////////////
+                else if(arg == "--rtc-host-clock") {
+                    options.rtc_host_clock = true;
+                }
+                ///////////////////////
+                // --indexed
+                ///////////////////////
+                else if(arg == "--indexed") {
+                    options.indexed_framebuffer = true;
+                }
+                ///////////////////////
                 // --skip-bootrom
                 ///////////////////////
                 else if(arg == "--skip-bootrom") {
                     options.skip_bootrom = true;
                 }
                 ///////////////////////
+                // --no-frameskip
+                ///////////////////////
+                else if(arg == "--no-frameskip") {
+                    options.auto_frameskip = false;
+                }
+                ///////////////////////
+                // --pixel-fifo
+                ///////////////////////
+                else if(arg == "--pixel-fifo") {
+                    options.pixel_fifo = true;
+                }
+                ///////////////////////
+                // --no-render-thread
+                ///////////////////////
+                else if(arg == "--no-render-thread") {
+                    options.render_thread = false;
+                }
+                ///////////////////////
                 // --no-framelimiter-hack
                 ///////////////////////
                 else if(arg == "--no-framelimiter-hack") {
@@ -161,39 +484,71 @@ int main(int argc, char* argv[])
     int height = 144;
     // Create the system instance
     Core::GameBoy* gameboy = ( new Core::GameBoy(options, width, height, rom, bootrom) );
+    // The cart keeps its own shared copy of the ROM
+    std::vector<u8>().swap(rom);
+    // Setup watchpoints
+    if(!watches.empty())
+    {
+        std::shared_ptr<Memory::MemoryBus>& memory_bus = gameboy->GetMemoryBus();
+        for(auto& watch : watches)
+            memory_bus->AddWatchpoint(watch.first, watch.second, Memory::WATCH_READ | Memory::WATCH_WRITE);
+        memory_bus->SetWatchCallback([](const Memory::WatchHit& hit) {
+            std::cout << std::hex << std::setfill('0')
+                      << ((hit.type == Memory::WATCH_WRITE)? "WRITE " : "READ  ")
+                      << std::setw(4) << hit.address << "h = "
+                      << std::setw(2) << static_cast<int>(hit.value) << "h"
+                      << " PC: " << std::setw(4) << hit.pc << "h"
+                      << std::dec << " cycle: " << hit.cycle << "\n";
+        });
+    }
+    if(!heatmap_path.empty())
+        gameboy->GetMemoryBus()->EnableProfile(true);
+    try
+    {
+        for(auto& cheat : cheats)
+            gameboy->GetMemoryBus()->AddCheat(cheat);
+    }
+    catch(std::invalid_argument& e)
+    {
+        std::cerr << e.what() << "\n";
+        return -1;
+    }
     // Initalize Render Context
     FrontEnd::SDLContext* sdl_context = new FrontEnd::SDLContext(width, height, options.scale, gameboy);
 
-    // TODO: Proper mutexes
-    bool update_frame = true;
-    bool poll_events = true;
     // Start the SDL thread
-    std::thread sdl_thread([gameboy, sdl_context, &update_frame, &poll_events](){
+    std::thread sdl_thread([gameboy, sdl_context](){
+        Core::PPU* ppu = gameboy->GetPPU().get();
         while(!gameboy->IsStopped() && !sdl_context->IsStopped())
         {
-            if(update_frame) {
-                sdl_context->Update(gameboy->GetPPU()->GetBackBuffer());
-                update_frame = false;
-                poll_events = true;
+            // only present frames the ppu has finished
+            bool presented;
+            if(ppu->IsIndexed())
+            {
+                if((presented = ppu->GetIndexedFrames().Acquire()))
+                    sdl_context->Update(*ppu, ppu->GetIndexedFrames().GetFront());
             }
-        }
-    });
-    // Start the main thread
-    {
-        while(!gameboy->IsStopped() && !sdl_context->IsStopped())
-        {
-            gameboy->Cycle();
-            update_frame = true;
+            else if((presented = ppu->GetFrames().Acquire()))
+                sdl_context->Update(ppu->GetFrames().GetFront());
 
-            if(poll_events) {
-                sdl_context->PollEvents(gameboy);
-                poll_events = false;
+            if(!presented)
+            {
+                sdl_context->PresentExposed();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
         }
-    }
+    });
+    // Start the main thread
+    if(options.pixel_fifo)
+        Run<Core::FifoTiming>(gameboy, sdl_context);
+    else
+        Run<Core::ScanlineTiming>(gameboy, sdl_context);
 
     // Ensure both threads don't delete
     sdl_thread.join();
+    if(!heatmap_path.empty() &&
+       !gameboy->GetMemoryBus()->SaveProfile(heatmap_path))
+        std::cerr << "Error writing heatmap!\n";
     if(gameboy)
         delete gameboy;
     if(sdl_context) {
@@ -19,6 +19,7 @@
 #include "core/PPU.h"
 #include "core/Rom.h"
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -28,7 +29,9 @@ namespace FrontEnd {
 SDLContext::SDLContext(int width, int height, int scale, Core::GameBoy* gameboy)
 : width(width),
   height(height),
-  scale(scale)
+  scale(scale),
+  shown_rows(height),
+  redraw(true)
 {
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         throw std::runtime_error("Error initializing render context! " + std::string(SDL_GetError()));
@@ -66,6 +69,11 @@ SDLContext::SDLContext(int width, int height, int scale, Core::GameBoy* gameboy)
         SDL_Quit();
         throw std::runtime_error("Error creating render texture! " + std::string(SDL_GetError()));
     }
+
+    // Frameskip draws at most this many frames a second
+    SDL_DisplayMode mode;
+    if(SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0)
+        gameboy->SetRefreshRate(mode.refresh_rate);
 }
 
 void SDLContext::Destroy()
@@ -76,20 +84,77 @@ void SDLContext::Destroy()
     SDL_Quit();
 }
 
-void SDLContext::Update(std::vector<Color>& back_buffer)
+bool SDLContext::ChangedRows(const std::vector<u64>& rowHashes, int& first, int& last)
+{
+    // after an expose the whole texture goes up again
+    if(redraw.exchange(false))
+    {
+        first = 0;
+        last = height;
+    }
+    else
+    {
+        first = 0;
+        while(first < height && rowHashes[first] == shown_rows[first])
+            first++;
+        if(first == height)
+            return false;
+        last = height;
+        while(rowHashes[last - 1] == shown_rows[last - 1])
+            last--;
+    }
+    std::copy(rowHashes.begin() + first, rowHashes.begin() + last, shown_rows.begin() + first);
+    return true;
+}
+
+void SDLContext::Present()
 {
+    exposed = false;
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, lcd_texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+void SDLContext::Update(const Graphics::Frame<Color>& frame)
+{
+    int first, last;
+    if(!ChangedRows(frame.rowHashes, first, last))
+        return;
+
+    SDL_Rect rows = { 0, first, width, last - first };
     int texture_pitch;
     SDL_LockTexture(lcd_texture,
-                    NULL,
+                    &rows,
                     reinterpret_cast<void**>(&front_buffer),
                     &texture_pitch);
-    memcpy((void*) front_buffer,
-           (void*) back_buffer.data(),
-           width*height*sizeof(Color));
+    u8* dest = reinterpret_cast<u8*>(front_buffer);
+    for(int row = first; row < last; row++, dest += texture_pitch)
+        memcpy(dest, &frame.pixels[row * width], width*sizeof(Color));
     SDL_UnlockTexture(lcd_texture);
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, lcd_texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
+    Present();
+}
+
+void SDLContext::Update(Core::PPU& ppu, const Graphics::Frame<u8>& frame)
+{
+    int first, last;
+    if(!ChangedRows(frame.rowHashes, first, last))
+        return;
+
+    SDL_Rect rows = { 0, first, width, last - first };
+    int texture_pitch;
+    SDL_LockTexture(lcd_texture,
+                    &rows,
+                    reinterpret_cast<void**>(&front_buffer),
+                    &texture_pitch);
+    ppu.ResolveRows(front_buffer, texture_pitch, frame.pixels, first, last);
+    SDL_UnlockTexture(lcd_texture);
+    Present();
+}
+
+void SDLContext::PresentExposed()
+{
+    if(exposed)
+        Present();
 }
 
 // This is actually called on the main thread.
@@ -102,6 +167,15 @@ void SDLContext::PollEvents(Core::GameBoy* gameboy)
         case SDL_QUIT:
             Stop();
             break;
+        case SDL_WINDOWEVENT:
+            // the window lost its contents. The SDL thread puts
+            // the texture back up, and the next frame has to be
+            // uploaded in full even if it's unchanged
+            if(window_event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                redraw = true;
+                exposed = true;
+            }
+            break;
         case SDL_KEYDOWN:
             switch(window_event.key.keysym.sym) {
             case SDLK_o:
@@ -15,13 +15,16 @@
 #pragma once
 
 #include "common/Types.h"
+#include "core/Renderer.h"
 
 #include <SDL2/SDL.h>
+#include <atomic>
 #include <vector>
 
 
 namespace Core {
 class GameBoy;
+class PPU;
 }; // namespace Core
 
 namespace FrontEnd {
@@ -39,8 +42,21 @@ class SDLContext
     SDL_Event window_event;
     // front render buffer that is drawn
     Color* front_buffer;
+    // Row hashes of what's in the texture, and whether
+    // the window needs a full redraw (set from PollEvents)
+    std::vector<u64> shown_rows;
+    std::atomic<bool> redraw;
+    // The window lost its contents and the texture
+    // hasn't been presented since
+    std::atomic<bool> exposed { false };
 
-    bool Stopped = false;
+    // Set on the main thread, read by the SDL thread
+    std::atomic<bool> Stopped { false };
+
+    // Finds the rows [first, last) that differ from the
+    // texture, false if there's nothing to upload
+    bool ChangedRows(const std::vector<u64>& rowHashes, int& first, int& last);
+    void Present();
 
 public:
     SDLContext(int width, int height, int scale, Core::GameBoy* gameboy);
@@ -51,7 +67,14 @@ public:
     bool IsStopped()
         { return Stopped; }
 
-    void Update(std::vector<Color>& back_buffer);
+    // Both only upload the rows that changed,
+    // and skip presenting a frame that's unchanged
+    void Update(const Graphics::Frame<Color>& frame);
+    // Resolves an indexed frame straight into the texture
+    void Update(Core::PPU& ppu, const Graphics::Frame<u8>& frame);
+    // Puts the texture back up after an expose, for
+    // when there's no new frame (e.g. the LCD is off)
+    void PresentExposed();
     void PollEvents(Core::GameBoy* gameboy);
 };
 
@@ -17,6 +17,9 @@
 
 // constants
 
+// CPU clock in cycles per second
+const int gClockSpeed = 4194304;
+
 // Colors are in little endian because of
 // how I'm swapping buffers
 const Color gColors[4] =
@@ -0,0 +1,39 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "Types.h"
+
+#include <cstddef>
+#include <cstring>
+
+// Where every hash starts
+const u64 gHashSeed = 0xCBF29CE484222325;
+
+// FNV-1a, a word at a time (so it won't match plain
+// FNV-1a). Pass a previous hash in to keep adding to it
+inline u64 HashBytes(const void* data, size_t size, u64 hash = gHashSeed)
+{
+    const u8* bytes = static_cast<const u8*>(data);
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+        u64 word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001B3;
+    }
+    for(; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    return hash;
+}
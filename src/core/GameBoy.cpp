@@ -39,7 +39,8 @@ GameBoy::GameBoy(GameBoy::Options& options,
     memory_bus = std::make_shared<Memory::MemoryBus>(this);
 
     processor = std::unique_ptr<Processor> (new Processor(this, memory_bus));
-    ppu = std::unique_ptr<PPU> (new PPU(this, width, height, memory_bus));
+    ppu = std::unique_ptr<PPU> (new PPU(this, width, height, memory_bus,
+                                        options.indexed_framebuffer, options.render_thread));
 
     game_rom = std::unique_ptr<Rom> (new Rom(rom, options.force_mbc));
     // load ROM at 0x0000-0x7FFF
@@ -47,7 +48,7 @@ GameBoy::GameBoy(GameBoy::Options& options,
 
     if(!_Options.skip_bootrom) {
         // load boot ROM at 0x0000-0x00FF
-        memory_bus->WriteBytes(bootrom.data(), 0x0000, 0x0100);
+        memory_bus->MapBootROM(bootrom.data());
         InBootROM = true;
     }
     
@@ -55,27 +56,6 @@ GameBoy::GameBoy(GameBoy::Options& options,
     Keys = 0xFF;
 }
 
-void GameBoy::Cycle()
-{
-    // Dirty hack to limit framerate without VSync 
-    if(_Options.framelimiter_hack &&
-       !SpeedEnabled ) {
-        if(framelimiter-- == 0)
-            framelimiter = FRAMELIMITER_MAX;
-        else
-            return;
-    }
-
-    int cycles = processor->Tick();
-        
-    if(ppu->Update(cycles) == -1)
-    {
-        Stop();
-    }
-
-    UpdateKeys();
-}
-
 void GameBoy::UpdateKeys()
 {
     u8 oldP1 = P1;
@@ -109,6 +89,24 @@ void GameBoy::DisableSpeed()
     SpeedEnabled = false;
 }
 
+void GameBoy::SetRefreshRate(int hz)
+{
+    PresentInterval = std::chrono::microseconds(1000000 / hz);
+}
+
+bool GameBoy::ShouldDrawFrame()
+{
+    // Going by the clock means the skip ratio adapts
+    // to however fast emulation is currently running
+    auto now = std::chrono::steady_clock::now();
+    if(SpeedEnabled && _Options.auto_frameskip &&
+       now - LastDrawnFrame < PresentInterval)
+        return false;
+
+    LastDrawnFrame = now;
+    return true;
+}
+
 void GameBoy::SystemError(const std::string& error_msg)
 {
     LOG_ERROR(error_msg);
@@ -19,7 +19,10 @@
 
 #include "../common/Types.h"
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
 #include <vector>
 
 
@@ -45,6 +48,23 @@ public:
         int force_mbc = -1;
         bool skip_bootrom = false;
         bool framelimiter_hack = true;
+        // Run the MBC3 clock off the host's clock
+        // instead of the emulated cycle count
+        bool rtc_host_clock = false;
+        // Where battery backed RAM is kept, empty to not save
+        std::string save_path;
+        // Draw shade indices and only turn them into
+        // colors when presenting (see PPU::ResolveRows)
+        bool indexed_framebuffer = false;
+        // While fast forwarding, only draw as many
+        // frames as the display can show
+        bool auto_frameskip = true;
+        // Draw frames on their own thread
+        // while the next one is emulated
+        bool render_thread = false;
+        // Time mode 3 like the real pixel FIFO (see FifoTiming),
+        // for games with mid-line effects. Costs some speed
+        bool pixel_fifo = false;
     };
     Options& GetOptions()
         { return _Options; }
@@ -55,17 +75,25 @@ public:
             const std::vector<u8>& rom,
             const std::vector<u8>& bootrom);
 
-    void Cycle(void);
+    // Runs one instruction. Timing is the PPU's, ScanlineTiming
+    // or FifoTiming as options.pixel_fifo says. Pick it once
+    // outside the loop that calls this
+    template<typename Timing>
+    void Cycle();
     void Stop()
         { Stopped = true; }
     bool IsStopped()
-        { return Stopped == true; }
+        { return Stopped; }
     bool IsInBootROM()
         { return InBootROM; }
     std::unique_ptr<Rom>& GetCurrentROM()
         { return game_rom; };
     std::unique_ptr<PPU>& GetPPU()
         { return ppu; }
+    std::shared_ptr<Memory::MemoryBus>& GetMemoryBus()
+        { return memory_bus; }
+    u64 GetCycles()
+        { return TotalCycles; }
 
     void UpdateKeys();
     void KeyPressed(u8 key);
@@ -74,6 +102,11 @@ public:
     bool SpeedEnabled = false;
     void EnableSpeed();
     void DisableSpeed();
+    // Set by the frontend to the display's refresh rate
+    void SetRefreshRate(int hz);
+    // Asked by the PPU at the start of each frame,
+    // false if the frame would never be presented
+    bool ShouldDrawFrame();
 
     void SystemError(const std::string& error_msg);
 
@@ -98,8 +131,41 @@ private:
     // System memory map
     std::shared_ptr<Memory::MemoryBus> memory_bus;
 
+    // Cycles run since power on
+    u64 TotalCycles = 0;
+
+    // For frameskip, the time between presented frames
+    // and when the last drawn frame was started
+    std::chrono::steady_clock::duration PresentInterval =
+        std::chrono::microseconds(1000000 / 60);
+    std::chrono::steady_clock::time_point LastDrawnFrame;
+
     bool InBootROM = false;
-    bool Stopped = false;
+    // Set on the main thread, read by the SDL thread
+    std::atomic<bool> Stopped { false };
 };
 
+template<typename Timing>
+inline void GameBoy::Cycle()
+{
+    // Dirty hack to limit framerate without VSync
+    if(_Options.framelimiter_hack &&
+       !SpeedEnabled ) {
+        if(framelimiter-- == 0)
+            framelimiter = FRAMELIMITER_MAX;
+        else
+            return;
+    }
+
+    int cycles = processor->Tick();
+    TotalCycles += cycles;
+
+    if(ppu->Update<Timing>(cycles) == -1)
+    {
+        Stop();
+    }
+
+    UpdateKeys();
+}
+
 }; // namespace Core
@@ -13,43 +13,72 @@
 // limitations under the License.
 
 #include "PPU.h"
+#include "GameBoy.h"
 #include "memory/MemoryBus.h"
 
 #include "../common/Globals.h"
 
+#include "../debug/Logger.h"
+
+#include <algorithm>
+#include <string>
 #include <stdexcept>
 
 
 namespace Core {
 
 PPU::PPU(GameBoy* gameboy, int width, int height,
-         std::shared_ptr<Memory::MemoryBus>& memory_bus)
+         std::shared_ptr<Memory::MemoryBus>& memory_bus,
+         bool indexed, bool threaded)
 :
     gameboy (gameboy),
     memory_bus (memory_bus),
     width (width),
-    height (height)
+    height (height),
+    indexed (indexed),
+    renderer (width, height, indexed)
 {
-    // initialize buffers
-    back_buffer = std::vector<Color>(width * height);
-    BGTileset = std::vector<Graphics::Tile>(256);
-    OBJTileset = std::vector<Graphics::Tile>(256);
+    if(threaded)
+        render_thread = std::unique_ptr<Graphics::RenderThread> (new Graphics::RenderThread(renderer));
+    LOG_MSG(std::string("Using ") + Graphics::GetKernelName() + " tile kernels");
+    // decode everything the first time round
+    for(int tile = 0; tile < TILE_COUNT; tile++)
+    {
+        TileDirty[tile] = true;
+        DirtyTiles.push_back(tile);
+    }
     // Start in DISPLAY_VBLANK
     STAT |= DISPLAY_VBLANK;
     // Setup blank palettes
-    BGPalette[0] = BGPalette[1] = BGPalette[2] = BGPalette[3] = gColors[0x00];
-    OBJ0Palette[0] = OBJ0Palette[1] = OBJ0Palette[2] = OBJ0Palette[3] = gColors[0x00];
-    OBJ1Palette[0] = OBJ1Palette[1] = OBJ1Palette[2] = OBJ1Palette[3] = gColors[0x00];
+    for(int palette = 0; palette < 3; palette++)
+        SetPalette(palette, 0x00);
 }
 
-std::vector<Color>& PPU::GetBackBuffer()
+void PPU::SetPalette(int palette, u8 data)
 {
-    return back_buffer;
+    // decoded by the renderer when a line that uses it is drawn
+    Palettes[palette] = data;
 }
 
+void PPU::ResolveRows(Color* dest, int pitch, const std::vector<u8>& frame,
+                      int first, int last, const Color* shades)
+{
+    for(int row = first; row < last; row++)
+    {
+        Color* line = reinterpret_cast<Color*>(reinterpret_cast<u8*>(dest) + ((row - first) * pitch));
+        // ExpandRow only looks at the shade bits
+        for(int x = 0; x < width; x += 8)
+            Graphics::ExpandRow(line + x, &frame[(row * width) + x], shades);
+    }
+}
+
+template<typename Timing>
 int PPU::Update(int cycles)
 {
     int return_code = 0;
+    // constants unless the FIFO stretches mode 3
+    const int mode3Cycles = Timing::PIXEL_FIFO? Mode3Cycles : MODE3_CYCLES;
+    const int hblankCycles = Timing::PIXEL_FIFO? HBlankCycles : HBLANK_CYCLES;
     if(LCDC & 0x80)
     {
         frameCycles += cycles;
@@ -57,18 +86,24 @@ int PPU::Update(int cycles)
         {
             case DISPLAY_HBLANK:
                 // TODO: Accurate cycles?
-                if(frameCycles > 207)
+                if(frameCycles > hblankCycles)
                 {
-                    // Draw this scanline
-                    DrawScanline();
+                    // Draw this scanline (later)
+                    if(!Timing::PIXEL_FIFO && drawFrame)
+                        LogScanline();
                     // Carry leftover cycles into next mode
-                    frameCycles %= 207;
+                    frameCycles %= hblankCycles;
                     if(++LY == 144)
                     {
                         // At the last line; enter V-Blank
                         STAT = (STAT & ~0x03) | DISPLAY_VBLANK;
                         // request V-Blank interrupt
                         memory_bus->Write8(0xFF0F, memory_bus->Read8(0xFF0F) | 0x01);
+                        memory_bus->VBlank();
+                        // draw the whole frame and hand it over,
+                        // skipped frames leave the last one showing
+                        if(drawFrame)
+                            RenderLines(true);
                     }
                     else
                     {
@@ -88,244 +123,285 @@ int PPU::Update(int cycles)
                 break;
             case DISPLAY_VBLANK:
                 // Have we completed a scanline?
-                if((static_cast<int>(frameCycles / 465) + 144) > LY)
+                if((static_cast<int>(frameCycles / LINE_CYCLES) + 144) > LY)
                 {
                     if(++LY > 153)
                     {
-                        frameCycles %= 4560;
+                        frameCycles %= VBLANK_CYCLES;
                         STAT = (STAT & ~0x03) | DISPLAY_OAMACCESS;
                         LY = 0;
+                        drawFrame = gameboy->ShouldDrawFrame();
                     }
                 }
                 break;
             case DISPLAY_OAMACCESS:
-                if(frameCycles > 83)
+                if(frameCycles > OAM_CYCLES)
                 {
-                    FetchScanlineSprites();
-                    frameCycles %= 83;
+                    // the FIFO's timing depends on the sprites
+                    // even on frames that aren't drawn
+                    if(drawFrame || Timing::PIXEL_FIFO)
+                        FetchScanlineSprites();
+                    if(Timing::PIXEL_FIFO)
+                        StartFifoLine();
+                    frameCycles %= OAM_CYCLES;
                     STAT = (STAT & ~0x03) | DISPLAY_UPDATE;
                 }
                 break;
             case DISPLAY_UPDATE:
-                if(frameCycles > 175)
+                if(frameCycles > mode3Cycles)
                 {
-                    frameCycles %= 175;
+                    // the line is done, it can be drawn now
+                    if(Timing::PIXEL_FIFO && drawFrame)
+                    {
+                        SplitOnWrite = false;
+                        LoggedLines = LY + 1;
+                    }
+                    frameCycles %= mode3Cycles;
                     STAT = (STAT & ~0x03) | DISPLAY_HBLANK;
-                    DecodeTiles();
                 }
                 break;
         }
     }
     else
     {
-        // If LCDC is disabled, reset all this stuff
+        // If LCDC is disabled, reset all this stuff.
+        // The unfinished frame is never shown
         frameCycles = 0;
         LY = 0;
+        LoggedLines = RenderedLines = 0;
+        LineSplits.clear();
+        SplitOnWrite = false;
     }
 
     return return_code;
 }
 
-void PPU::DrawScanline()
+void PPU::LogScanline()
+{
+    SnapshotLine();
+    LoggedLines = LY + 1;
+}
+
+void PPU::SnapshotLine()
 {
-    for(int x = 0; x < width; x++)
+    // LY was written or the LCD turned off partway through,
+    // so start a new run of lines here
+    if(LY != LoggedLines)
     {
-        int y = LY;
-
-        // Tile and pixel to draw
-        u8 tileY = y / 8;
-        u8 tileX = x / 8;
-        u8 pixelY = y % 8;
-        u8 pixelX = x % 8;
-        // Scroll offsets
-        u8 tileYoff = SCY / 8;
-        u8 tileXoff = SCX / 8;
-        u8 pixelYoff = SCY % 8;
-        u8 pixelXoff = SCX % 8;
-        // boundary between the scroll tiles
-        u8 upperHalf = (8 - pixelYoff);
-        u8 leftHalf = (8 - pixelXoff);
-        // tile to take from the BG map
-        u8 fetchY = tileY+tileYoff;
-        u8 fetchX = tileX+tileXoff;
-        if(pixelY >= upperHalf)
-        {
-            // start drawing from the top
-            // of the next tile down
-            fetchY++;
-            pixelY -= upperHalf;
-            pixelYoff = 0;
-        }
-        if(pixelX >= leftHalf)
+        FlushLines();
+        LoggedLines = RenderedLines = LY;
+        // any left belong to lines that were never finished
+        LineSplits.clear();
+    }
+    CopyRegisters(LineLog[LY]);
+}
+
+void PPU::CopyRegisters(Graphics::LineRegisters& regs)
+{
+    regs.LCDC = LCDC;
+    regs.SCY = SCY;
+    regs.SCX = SCX;
+    regs.WY = WY;
+    regs.WX = WX;
+    for(int palette = 0; palette < 3; palette++)
+        regs.Palettes[palette] = Palettes[palette];
+}
+
+void PPU::StartFifoLine()
+{
+    // The first two tile fetches come before any pixels,
+    // then the pixels SCX scrolls off are thrown away
+    int penalty = SCX % 8;
+    FifoStartup = (MODE3_CYCLES - width) + penalty;
+    StallCount = 0;
+
+    // the window restarts the fetcher
+    if((LCDC & 0x20) && LY >= WY && WX <= 166)
+    {
+        Stalls[StallCount++] = { std::max(0, WX - 7), 6 };
+        penalty += 6;
+    }
+    // each sprite waits for its tile, and longer
+    // the earlier in the BG tile fetch it lands
+    if((LCDC & 0x02) && LY < LINES)
+    {
+        const Graphics::LineRegisters& regs = LineLog[LY];
+        for(int i = 0; i < regs.SpriteCount; i++)
         {
-            fetchX++;
-            pixelX -= leftHalf;
-            pixelXoff = 0;
-        }
-        // wrap around
-        if(fetchY >= 32)
-            fetchY %= 32;
-        if(fetchX >= 32)
-            fetchX %= 32;
-        // fetch the tile to draw
-        u16 base = 0x9800;
-        if(LCDC & 0x08) {
-            base += 0x0400;
+            int x = regs.Sprites[i]._x - 8;
+            if(x >= width)
+                continue;
+            int cycles = 11 - std::min(5, (x + SCX) & 0x07);
+            Stalls[StallCount++] = { std::max(0, x), cycles };
+            penalty += cycles;
         }
-        u8 tileID = memory_bus->Read8(base + (fetchY * 32) + fetchX);
-        // Draw the pixel
-        int drawY = LY * width;
-        int drawX = x;
-        back_buffer[drawY + drawX] = BGPalette[BGTileset[tileID].GetPixel(pixelX+pixelXoff, pixelY+pixelYoff)];
     }
+    std::sort(Stalls, Stalls + StallCount, [](const FifoStall& a, const FifoStall& b) {
+        return a.x < b.x;
+    });
 
-    if((LCDC & 0x20) && LY >= WY) {
-        DrawScanlineWindow();
-    }
-    if(LCDC & 0x02) {
-        DrawScanlineSprites();
+    // the line stays the same length, H-Blank gives up the difference
+    Mode3Cycles = MODE3_CYCLES + penalty;
+    HBlankCycles = HBLANK_CYCLES - penalty;
+
+    if(drawFrame && LY < LINES)
+    {
+        SnapshotLine();
+        // splits from an earlier try at this line
+        while(!LineSplits.empty() && LineSplits.back().ly >= LY)
+            LineSplits.pop_back();
+        SplitOnWrite = true;
     }
 }
 
-void PPU::DrawScanlineWindow()
+int PPU::GetFifoPixel()
 {
-    // TODO: Track progress since window drawing
-    // can be stopped and started again at a later LY
-
-    // TODO: It seems I've reached my first impass not
-    // having perfect cycle-count accuracy:
-    // If the window is disabled partway down the screen,
-    // it doesn't draw the last line of the window.
-    // (window is disabled before window finishes drawing)
-    for(int x = WX; x < width + 7; x++)
+    // frameCycles counts up from the start of mode 3
+    int x = frameCycles - FifoStartup;
+    for(int i = 0; i < StallCount && x > Stalls[i].x; i++)
+        x = std::max(Stalls[i].x, x - Stalls[i].cycles);
+    return std::max(0, std::min(x, width));
+}
+
+void PPU::SplitLine()
+{
+    int x = GetFifoPixel();
+    if(x >= width)
+        return;
+    if(x == 0)
     {
-        int y = LY;
-        // Tile and pixel to draw
-        u8 tileY = (LY - WY) / 8;
-        u8 tileX = (x - WX) / 8;
-        u8 pixelY = (LY - WY) % 8;
-        u8 pixelX = (x - WX) % 8;
-        // fetch the tile to draw
-        u16 base = 0x9800;
-        if(LCDC & 0x40) {
-            base += 0x0400;
-        }
-        u8 tileID = memory_bus->Read8(base + (tileY * 32) + tileX);
-        // Draw the pixel
-        int drawY = y * width;
-        int drawX = x - 7;
-        if(drawX < 0)
-            continue;
-        
-        back_buffer[drawY + drawX] = BGPalette[BGTileset[tileID].GetPixel(pixelX, pixelY)];
+        // nothing's been output yet, so the whole line changes
+        CopyRegisters(LineLog[LY]);
+        return;
     }
+    // keeps the line's sprites
+    Graphics::LineSplit split = { LY, x, LineLog[LY] };
+    CopyRegisters(split.regs);
+    LineSplits.push_back(split);
 }
 
-void PPU::DrawScanlineSprites()
+void PPU::FinishRendering()
 {
-    const int SPRITE_HEIGHT = (LCDC & 04)? 16 : 8;
+    if(render_thread)
+        render_thread->Finish();
+}
 
-    for(auto it = ScanlineSprites.begin(); it != ScanlineSprites.end(); it++)
+void PPU::RenderLines(bool publish)
+{
+    // The PPU has its own bus to VRAM, so it
+    // isn't affected by the DMA lockout
+    const u8* vram = memory_bus->GetVRAM();
+    bool pending = RenderedLines != LoggedLines;
+    // only the splits for lines being drawn go along,
+    // the line in mode 3 can still get more
+    size_t splits = 0;
+    while(splits < LineSplits.size() && LineSplits[splits].ly < LoggedLines)
+        splits++;
+    if(render_thread)
     {
-        Graphics::Sprite& sprite = *it;
-        // offset by 16 to align with Sprite y
-        int adjScanline = LY + 16;
-        int y = sprite._y;
-        int x = sprite._x;
-        const Color* palette = (sprite.palette == 0)? OBJ0Palette : OBJ1Palette;
-        for(int px = 0; px < 8; px++)
+        // the thread keeps its own VRAM, see WriteVRAM
+        if(pending)
+            render_thread->DrawLines(LineLog, RenderedLines, LoggedLines,
+                                     LineSplits.data(), splits);
+        if(publish)
+            render_thread->Submit(true);
+    }
+    else
+    {
+        if(pending)
         {
-            // don't draw the x pixels if they are offscreen
-            if(x+px < 8 || x+px >= 168)
-                continue;
-            // flip sprites
-            int oamX = (sprite.flipX)? (7 - px) : px;
-            int oamY = (sprite.flipY)? ((SPRITE_HEIGHT - 1) - (adjScanline - y)) : (adjScanline - y);
-            u8 color = OBJTileset[sprite.id].GetPixel(oamX, oamY);
-            // 00 is transparent for sprites: use the color of the background instead
-            if(color == 0x00)
-                continue;
-            int drawY = LY * width;
-            int drawX = (x - 8) + px;
-            back_buffer[drawY + drawX] = palette[color];
+            // the tiles have to match VRAM as the lines saw it
+            renderer.DecodeTiles(vram, DirtyTiles.data(), DirtyTiles.size());
+            renderer.DrawLines(vram, LineLog, RenderedLines, LoggedLines,
+                               LineSplits.data(), splits);
         }
+        if(publish)
+            renderer.Publish();
     }
-    ScanlineSprites.clear();
+
+    // the dirty tiles only go along with lines to draw
+    if(pending)
+    {
+        for(u16 tile : DirtyTiles)
+            TileDirty[tile] = false;
+        DirtyTiles.clear();
+        LineSplits.erase(LineSplits.begin(), LineSplits.begin() + splits);
+    }
+    RenderedLines = LoggedLines;
+    if(publish)
+        PublishedFrames++;
 }
 
 void PPU::FetchScanlineSprites()
+{
+    const int SPRITE_HEIGHT = (LCDC & 04)? 16 : 8;
+    if(OAMDirty || SPRITE_HEIGHT != LineSpriteHeight)
+        BucketSprites();
+
+    if(LY >= LINES)
+        return;
+    // LY went backwards onto a line still waiting to be drawn
+    if(LY < LoggedLines)
+        FlushLines();
+    // copied so OAM writes during the line don't affect it
+    Graphics::LineRegisters& regs = LineLog[LY];
+    regs.SpriteCount = LineSpriteCount[LY];
+    for(int i = 0; i < regs.SpriteCount; i++)
+        regs.Sprites[i] = OAMSprites[LineSprites[LY][i]];
+}
+
+void PPU::BucketSprites()
 {
     const int OAM_SIZE = 4;
-    const int OAM_COUNT = 40;
     const int SPRITE_HEIGHT = (LCDC & 04)? 16 : 8;
+    // The PPU reads OAM directly
+    const u8* oam = memory_bus->GetOAM();
 
-    int spriteCounter = 0;
+    std::fill(LineSpriteCount, LineSpriteCount + LINES, 0);
     for(int i = 0; i < OAM_COUNT; i++)
     {
-        Graphics::Sprite sprite;
-        u8 buffer[4];
-        memory_bus->ReadBytes(buffer, 0xFE00 + (i * OAM_SIZE), OAM_SIZE);
-        sprite.Decode(buffer);
-        // offset by 16 to align with Sprite y
-        u8 adjScanline = LY + 16;
+        Graphics::Sprite& sprite = OAMSprites[i];
+        sprite.Decode(oam + (i * OAM_SIZE));
         u8 y = sprite._y;
         u8 x = sprite._x;
         // if the sprite is offscreen
         // sprites start at (8, 16) so you can scroll them in
         if((y == 0 || y >= 160) || (x == 0 || x >= 168))
             continue;
-        // if the sprite is not within range of this scanline
-        if(adjScanline < y || (adjScanline - y) >= SPRITE_HEIGHT)
-            continue;
-        // only 10 sprites per scanline
-        if(++spriteCounter > 10)
-            return;
-
-        ScanlineSprites.push_back(sprite);
+        // offset by 16 to align with Sprite y
+        int top = y - 16;
+        int bottom = std::min<int>(top + SPRITE_HEIGHT, int(LINES));
+        for(int line = std::max(top, 0); line < bottom; line++)
+        {
+            // only 10 sprites per scanline, the first in OAM win
+            if(LineSpriteCount[line] < MAX_LINE_SPRITES)
+                LineSprites[line][LineSpriteCount[line]++] = i;
+        }
     }
+
+    OAMDirty = false;
+    LineSpriteHeight = SPRITE_HEIGHT;
 }
 
-void PPU::DecodeTiles()
+void PPU::WriteVRAM(u16 address, u8 data)
 {
-    // fetch each tile in the tileset from VRAM
-    // and decode their 2-bit colors
-    const int BG_SIZE = 16;
-    const int OBJ_SIZE = 16;
-
-    // Background Tileset
-    for(int bg = 0; bg < 256; bg++)
+    if(render_thread)
     {
-        // if LCDC bit 4 == 0,
-        // BG tiles 00-7F start at 0x9000
-        // and 80-FF start at 0x8800
-        // Otherwise, BG tiles align with
-        // OBJ tiles at 0x8000
-        u16 base = 0x8000;
-        u8 rawTile = bg;
-        if((LCDC & 0x10) == 0)
-        {
-            if(bg >= 128)
-            {
-                base = 0x8800;
-                // start fetching from 0x8800,
-                // not 0x8800 + 128 tiles
-                rawTile -= 128;
-            }
-            else
-                base = 0x9000;
-        }
-
-        u8 buffer[BG_SIZE];
-        memory_bus->ReadBytes(buffer, base + (rawTile * BG_SIZE), BG_SIZE);
-        BGTileset.at(bg).Decode(buffer);
+        render_thread->WriteVRAM(address - 0x8000, data);
+        return;
     }
-    // Sprite tileset
-    for(int obj = 0; obj < 256; obj++)
+    // tile data writes mark the tiles for re-decoding
+    if(address >= 0x9800)
+        return;
+    u16 tile = (address - 0x8000) / 16;
+    if(!TileDirty[tile])
     {
-        u8 buffer[OBJ_SIZE];
-        memory_bus->ReadBytes(buffer, 0x8000 + (obj * OBJ_SIZE), OBJ_SIZE);
-        OBJTileset.at(obj).Decode(buffer);
+        TileDirty[tile] = true;
+        DirtyTiles.push_back(tile);
     }
 }
 
+template int PPU::Update<ScanlineTiming>(int cycles);
+template int PPU::Update<FifoTiming>(int cycles);
+
 }; // namespace Core
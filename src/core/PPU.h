@@ -14,7 +14,11 @@
 
 #pragma once
 
+#include "Renderer.h"
+#include "RenderThread.h"
+
 #include "../common/Types.h"
+#include "../common/Globals.h"
 
 #include <vector>
 #include <memory>
@@ -24,115 +28,185 @@ namespace Memory {
     class MemoryBus;
 }; // namespace Memory
 
-namespace Graphics {
-    struct Tile
-    {
-        // pixels are stored every two bits
-        // 16 bits per row for 8 rows
-        u16 rows[8];
-
-        inline void Decode(const u8* src)
-        {
-            // interleave the bits
-            for(int row = 0; row < 8; row++)
-            {
-                u32 upper = static_cast<u32>(src[(row*2)+1]) << 16;
-                u32 lower = static_cast<u32>(src[row*2]);
-                u32 morton = upper | lower;
-                morton = (morton ^ (morton << 4)) & 0x0F0F0F0F; // separate nybbles
-                morton = (morton ^ (morton << 2)) & 0x33333333; // separate half-nybbles
-                morton = (morton ^ (morton << 1)) & 0x55555555; // separate bits
-                rows[row] = static_cast<u16>(morton | (morton >> 15));
-            }
-        }
-
-        inline const u8 GetPixel(u8 x, u8 y)
-        {
-            // mask out the two bits for the pixel we want
-            // then shift it back to the bottom for an
-            // array index
-            x *= 2;
-            return static_cast<u8>((rows[y] & (0xC000 >> x)) >> (14 - x));
-        }
-    };
-
-    struct Sprite
-    {
-        u8 _y;
-        u8 _x;
-        u8 id;
-        u8 priority;
-        bool flipY;
-        bool flipX;
-        u8 palette;
-
-        inline void Decode(const u8* src)
-        {
-            _y = src[0];
-            _x = src[1];
-            id = src[2];
-            priority = (src[3] & 0b10000000) >> 7;
-            flipY = (src[3] & 0b01000000) != 0;
-            flipX = (src[3] & 0b00100000) != 0;
-            palette = (src[3] & 0b00010000) >> 4;
-        }
-    };
-}; // namespace Graphics
-
 namespace Core {
 class GameBoy;
 
+// How PPU::Update times each line, picked at compile time
+// so the scanline timing pays nothing for the FIFO's extras.
+//
+// Fixed mode lengths, and each line is drawn with the
+// registers as they were at the end of it
+struct ScanlineTiming
+{
+    static const bool PIXEL_FIFO = false;
+};
+// Times mode 3 like the pixel FIFO, stretching it for fine
+// scrolling, the window and sprites. Registers are taken at
+// the start of mode 3, and writes during it only change the
+// pixels after the one being output
+struct FifoTiming
+{
+    static const bool PIXEL_FIFO = true;
+};
+
 class PPU
 {
     friend class Memory::MemoryBus;
     // IO Registers
     // LCD controller
-    u8 LCDC;
+    u8 LCDC = 0;
     // LCD Status
-    u8 STAT;
-    u8 SCY, SCX;
-    u8 LY;
+    u8 STAT = 0;
+    u8 SCY = 0, SCX = 0;
+    u8 LY = 0;
     // Acts as a breakpoint
-    u8 LYC;
-    // Palettes
-    Color BGPalette[4];
-    Color OBJ0Palette[4];
-    Color OBJ1Palette[4];
+    u8 LYC = 0;
+    // BGP, OBP0 and OBP1
+    u8 Palettes[3];
     // Position of the Window, X is minus 7
     u8 WY = 0, WX = 0;
 
-    // Back buffer the ppu draws to
-    std::vector<Color> back_buffer;
-    // Spritesheets
-    std::vector<Graphics::Tile> BGTileset;
-    std::vector<Graphics::Tile> OBJTileset;
-    // Sprites to draw
-    std::vector<Graphics::Sprite> ScanlineSprites;
+
+    // Tiles written since the renderer last decoded them,
+    // a RenderThread keeps track of its own
+    static const int TILE_COUNT = Graphics::Renderer::TILE_COUNT;
+    bool TileDirty[TILE_COUNT];
+    std::vector<u16> DirtyTiles;
+    // Decoded copy of OAM, and which sprites are on each line.
+    // Both are rebuilt in one pass whenever OAM or the sprite size changes
+    static const int OAM_COUNT = 40;
+    static const int LINES = 144;
+    static const int MAX_LINE_SPRITES = Graphics::LineRegisters::MAX_SPRITES;
+    Graphics::Sprite OAMSprites[OAM_COUNT];
+    u8 LineSprites[LINES][MAX_LINE_SPRITES];
+    u8 LineSpriteCount[LINES];
+    bool OAMDirty = true;
+    int LineSpriteHeight = 0;
+    void BucketSprites();
+
+    // Lines aren't drawn as the PPU gets to them. Each one just
+    // logs the registers it would have been drawn with, and they're
+    // all drawn in one go at V-Blank. VRAM writes draw any pending
+    // lines first, since they'd see the old VRAM
+    Graphics::LineRegisters LineLog[LINES];
+    // Lines [RenderedLines, LoggedLines) are waiting to be drawn
+    int LoggedLines = 0;
+    int RenderedLines = 0;
+    // Draws (or queues) the pending lines, then
+    // hands the frame to the frontend if publish is set
+    void RenderLines(bool publish = false);
+    // Puts the current registers in the log entry for LY
+    void SnapshotLine();
+    void CopyRegisters(Graphics::LineRegisters& regs);
+
+    // Mode lengths for the current line
+    static const int OAM_CYCLES = 83;
+    static const int MODE3_CYCLES = 175;
+    static const int HBLANK_CYCLES = 207;
+    int Mode3Cycles = MODE3_CYCLES;
+    int HBlankCycles = HBLANK_CYCLES;
+    // FifoTiming: how long the FIFO waits before the first pixel,
+    // then where on the line it stalls and for how long, in x order
+    struct FifoStall
+    {
+        int x;
+        int cycles;
+    };
+    int FifoStartup = 0;
+    FifoStall Stalls[MAX_LINE_SPRITES + 1];
+    int StallCount = 0;
+    // Set during mode 3 with FifoTiming, so register writes split the line
+    bool SplitOnWrite = false;
+    // Splits for the logged lines and the one in mode 3, in line order
+    std::vector<Graphics::LineSplit> LineSplits;
+    void StartFifoLine();
+    // The pixel the FIFO is about to output
+    int GetFifoPixel();
+    void SplitLine();
 
     // Window size
     int width;
     int height;
 
+    bool indexed;
+    Graphics::Renderer renderer;
+    // Runs the renderer when drawing on another thread,
+    // only the worker touches the renderer then
+    std::unique_ptr<Graphics::RenderThread> render_thread;
+    // Frames handed to the renderer to publish so far
+    u64 PublishedFrames = 0;
+
     // cycle counter per frame
-    int frameCycles;
+    int frameCycles = 0;
+    // Cleared for frames skipped by frameskip, which still run
+    // all the timing but don't draw anything
+    bool drawFrame = true;
 
     // system pointers
     GameBoy* gameboy;
     std::shared_ptr<Memory::MemoryBus> memory_bus;
 
 public:
+    // How long a line, V-Blank and a whole frame take
+    static const int LINE_CYCLES = 465;
+    static const int VBLANK_CYCLES = 4560;
+    static const int FRAME_CYCLES = 144 * LINE_CYCLES + VBLANK_CYCLES;
+
+    // threaded draws frames on a RenderThread
     PPU(GameBoy* gameboy, int width, int height,
-        std::shared_ptr<Memory::MemoryBus>& memory_bus);
+        std::shared_ptr<Memory::MemoryBus>& memory_bus,
+        bool indexed = false, bool threaded = false);
 
+    // Timing is ScanlineTiming or FifoTiming. It's picked
+    // once above the emulation loop (see GameBoy::Cycle),
+    // so every instruction makes a direct call
+    template<typename Timing>
     int Update(int cycles);
 
-    std::vector<Color>& GetBackBuffer();
-
-    void DrawScanline();
-    void DrawScanlineWindow();
-    void DrawScanlineSprites();
+    // Finished frames, for the frontend to Acquire from any thread.
+    // Only drawn to when not in indexed mode
+    Graphics::TripleBuffer<Graphics::Frame<Color>>& GetFrames()
+        { return renderer.GetFrames(); }
+    // Only drawn to in indexed mode, each pixel
+    // is a Graphics::Renderer::PixelIndex
+    Graphics::TripleBuffer<Graphics::Frame<u8>>& GetIndexedFrames()
+        { return renderer.GetIndexedFrames(); }
+    bool IsIndexed()
+        { return indexed; }
+    u64 GetPublishedFrames()
+        { return PublishedFrames; }
+    // Waits until every published frame has been drawn,
+    // so Acquire is sure to get the latest one
+    void FinishRendering();
+    // Turns rows [first, last) of an indexed frame into colors,
+    // dest is row first and rows are pitch bytes apart.
+    // shades is the color for each of the 4 shades
+    void ResolveRows(Color* dest, int pitch, const std::vector<u8>& frame,
+                     int first, int last, const Color* shades = gColors);
+
+    // Decodes a write to BGP (0), OBP0 (1) or OBP1 (2)
+    void SetPalette(int palette, u8 data);
+
+    // Logs the current line to be drawn later
+    void LogScanline();
     void FetchScanlineSprites();
-    void DecodeTiles();
+    // Draws every logged line that hasn't been drawn yet
+    void FlushLines()
+    {
+        if(RenderedLines != LoggedLines)
+            RenderLines();
+    }
+    // Called after writes to any register lines are drawn with
+    void RegisterWritten()
+    {
+        if(SplitOnWrite)
+            SplitLine();
+    }
+    // Called after every write to VRAM
+    void WriteVRAM(u16 address, u8 data);
+    // Called on writes to OAM, and OAM DMA
+    void MarkOAMDirty()
+        { OAMDirty = true; }
 };
 
 }; // namespace Core
@@ -0,0 +1,188 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "RenderThread.h"
+
+#include <algorithm>
+
+
+namespace Graphics {
+
+RenderThread::RenderThread(Renderer& renderer)
+:   renderer (renderer),
+    jobs (new Job[QUEUE_SIZE]),
+    head (0),
+    tail (0),
+    open (nullptr),
+    vram (),
+    stopping (false)
+{
+    // reserved up front, so filling a job doesn't allocate
+    for(u32 i = 0; i < QUEUE_SIZE; i++)
+    {
+        jobs[i].writes.reserve(MAX_WRITES);
+        jobs[i].batches.reserve(LINES);
+        jobs[i].splits.reserve(MAX_SPLITS);
+    }
+    // decode everything the first time round
+    for(int tile = 0; tile < Renderer::TILE_COUNT; tile++)
+    {
+        TileDirty[tile] = true;
+        DirtyTiles.push_back(tile);
+    }
+    worker = std::thread(&RenderThread::Run, this);
+}
+
+RenderThread::~RenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock (wait_mutex);
+        stopping = true;
+    }
+    queued.notify_one();
+    worker.join();
+}
+
+RenderThread::Job& RenderThread::Open()
+{
+    if(open)
+        return *open;
+
+    u32 slot = head.load(std::memory_order_relaxed);
+    // the worker is a whole queue behind
+    if(slot - tail.load(std::memory_order_acquire) == QUEUE_SIZE)
+    {
+        std::unique_lock<std::mutex> lock (wait_mutex);
+        finished.wait(lock, [&]() {
+            return slot - tail.load(std::memory_order_acquire) != QUEUE_SIZE;
+        });
+    }
+
+    open = &jobs[slot % QUEUE_SIZE];
+    open->writes.clear();
+    open->batches.clear();
+    open->splits.clear();
+    open->logged = 0;
+    open->publish = false;
+    return *open;
+}
+
+void RenderThread::WriteVRAM(u16 address, u8 data)
+{
+    Job& job = Open();
+    job.writes.push_back({ address, data });
+    if(job.writes.size() == MAX_WRITES)
+        Submit(false);
+}
+
+void RenderThread::DrawLines(const LineRegisters* log, int first, int last,
+                             const LineSplit* splits, size_t splitCount)
+{
+    // LY went backwards, the lines in the job
+    // still need their old log entries
+    if(first < Open().logged)
+        Submit(false);
+
+    Job& job = Open();
+    std::copy(log + first, log + last, job.log + first);
+    job.splits.insert(job.splits.end(), splits, splits + splitCount);
+    job.batches.push_back({ first, last, static_cast<u32>(job.writes.size()),
+                            static_cast<u32>(job.splits.size()) });
+    job.logged = last;
+}
+
+void RenderThread::Submit(bool publish)
+{
+    Open().publish = publish;
+    open = nullptr;
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock (wait_mutex);
+    }
+    queued.notify_one();
+}
+
+void RenderThread::Finish()
+{
+    u32 slot = head.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock (wait_mutex);
+    finished.wait(lock, [&]() {
+        return tail.load(std::memory_order_acquire) == slot;
+    });
+}
+
+void RenderThread::Apply(const Job& job, u32 first, u32 last)
+{
+    for(u32 i = first; i < last; i++)
+    {
+        const Write& write = job.writes[i];
+        vram[write.address] = write.data;
+        // tile data writes mark the tiles for re-decoding
+        u16 tile = write.address / 16;
+        if(write.address < TILE_DATA_SIZE && !TileDirty[tile])
+        {
+            TileDirty[tile] = true;
+            DirtyTiles.push_back(tile);
+        }
+    }
+}
+
+void RenderThread::Run()
+{
+    u32 slot = tail.load(std::memory_order_relaxed);
+    while(true)
+    {
+        if(head.load(std::memory_order_acquire) == slot)
+        {
+            std::unique_lock<std::mutex> lock (wait_mutex);
+            queued.wait(lock, [&]() {
+                return stopping || head.load(std::memory_order_acquire) != slot;
+            });
+            if(head.load(std::memory_order_acquire) == slot)
+                break;
+            continue;
+        }
+
+        const Job& job = jobs[slot % QUEUE_SIZE];
+        u32 write = 0;
+        u32 split = 0;
+        for(const Batch& batch : job.batches)
+        {
+            Apply(job, write, batch.writeEnd);
+            write = batch.writeEnd;
+            // the tiles have to match VRAM as the lines saw it
+            renderer.DecodeTiles(vram, DirtyTiles.data(), DirtyTiles.size());
+            for(u16 tile : DirtyTiles)
+                TileDirty[tile] = false;
+            DirtyTiles.clear();
+            renderer.DrawLines(vram, job.log, batch.first, batch.last,
+                               job.splits.data() + split, batch.splitEnd - split);
+            split = batch.splitEnd;
+        }
+        // writes after the last lines are
+        // for the next job's lines to see
+        Apply(job, write, job.writes.size());
+        if(job.publish)
+            renderer.Publish();
+
+        tail.store(++slot, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock (wait_mutex);
+        }
+        finished.notify_one();
+    }
+}
+
+}; // namespace Graphics
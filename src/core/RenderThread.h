@@ -0,0 +1,120 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#pragma once
+
+#include "Renderer.h"
+
+#include "../common/Types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Graphics {
+
+// Runs a Renderer on its own thread, so the PPU only has to
+// keep time. The worker keeps its own copy of VRAM, and each
+// job is a frame's worth of VRAM writes, interleaved with the
+// lines to draw between them. Jobs are handed over through a
+// single producer, single consumer ring.
+// Frames come out the same as drawing them inline
+class RenderThread
+{
+    static const int VRAM_SIZE = 0x2000;
+    static const int LINES = 144;
+    static const int TILE_DATA_SIZE = Renderer::TILE_COUNT * 16;
+    // Jobs that can be in flight, most frames only need one
+    static const u32 QUEUE_SIZE = 8;
+    // A job is handed over early once it has this many writes
+    static const u32 MAX_WRITES = VRAM_SIZE;
+    // Room for a few splits a line before splits has to grow
+    static const u32 MAX_SPLITS = LINES * 4;
+
+    struct Write
+    {
+        u16 address;
+        u8 data;
+    };
+    // Draw lines [first, last) once the writes before
+    // writeEnd are in, with the splits before splitEnd
+    struct Batch
+    {
+        int first, last;
+        u32 writeEnd;
+        u32 splitEnd;
+    };
+    struct Job
+    {
+        std::vector<Write> writes;
+        std::vector<Batch> batches;
+        LineRegisters log[LINES];
+        std::vector<LineSplit> splits;
+        // the log holds lines below this already
+        int logged;
+        bool publish;
+    };
+
+    Renderer& renderer;
+    std::unique_ptr<Job[]> jobs;
+    // Only the PPU moves head, and only the worker moves tail
+    std::atomic<u32> head;
+    std::atomic<u32> tail;
+    // The job the PPU is filling in, nullptr until it needs one
+    Job* open;
+
+    // Only the worker touches these
+    u8 vram[VRAM_SIZE];
+    bool TileDirty[Renderer::TILE_COUNT];
+    std::vector<u16> DirtyTiles;
+
+    // Only used to sleep while the queue is empty (worker)
+    // or full (PPU), never held while touching the queue
+    std::mutex wait_mutex;
+    std::condition_variable queued;
+    std::condition_variable finished;
+    std::atomic<bool> stopping;
+    std::thread worker;
+
+    Job& Open();
+    void Apply(const Job& job, u32 first, u32 last);
+    void Run();
+
+public:
+    RenderThread(Renderer& renderer);
+    // Draws whatever is still queued first
+    ~RenderThread();
+
+    // Called for every write to VRAM, address is from 0x8000.
+    // VRAM starts out zeroed, so this is all the worker needs
+    // to keep its copy in step
+    void WriteVRAM(u16 address, u8 data);
+    // Draws lines [first, last) of the log with their
+    // splits, as of the VRAM writes queued so far
+    void DrawLines(const LineRegisters* log, int first, int last,
+                   const LineSplit* splits, size_t splitCount);
+    // Hands the job over, then the frame once it's drawn
+    // if publish is set. Waits if the queue is full
+    void Submit(bool publish);
+    // Waits until everything submitted has been drawn
+    void Finish();
+};
+
+}; // namespace Graphics
@@ -0,0 +1,317 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Renderer.h"
+
+#include "../common/Globals.h"
+#include "../common/Hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace Graphics {
+
+Renderer::Renderer(int width, int height, bool indexed)
+:   Tiles (TILE_COUNT),
+    width (width),
+    height (height),
+    indexed (indexed),
+    frames (indexed? Frame<Color>(0, 0) : Frame<Color>(width, height)),
+    indexed_frames (indexed? Frame<u8>(width, height) : Frame<u8>(0, 0)),
+    MapBitmaps (2 * MAP_SIZE * MAP_SIZE),
+    ColorScratch (indexed? 0 : width),
+    IndexScratch (indexed? width : 0)
+{
+    // nothing is drawn into the bitmaps yet
+    for(int map = 0; map < 2; map++)
+    {
+        std::fill(MapTiles[map], MapTiles[map] + MAP_TILES, 0);
+        std::fill(MapTileValid[map], MapTileValid[map] + MAP_TILES, false);
+        MapTileSelect[map] = 0;
+    }
+    // Setup blank palettes
+    for(int palette = 0; palette < 3; palette++)
+        DecodePalette(palette, 0x00);
+}
+
+void Renderer::DecodePalette(int palette, u8 data)
+{
+    Color* colors[3] = { BGPalette, OBJ0Palette, OBJ1Palette };
+    u8* indices[3] = { BGIndices, OBJ0Indices, OBJ1Indices };
+    const u8 source[3] = { INDEX_BG, INDEX_OBJ0, INDEX_OBJ1 };
+    for(int i = 0; i < 4; i++)
+    {
+        u8 shade = (data >> (i * 2)) & 0x03;
+        colors[palette][i] = gColors[shade];
+        indices[palette][i] = source[palette] | shade;
+    }
+    DecodedPalettes[palette] = data;
+}
+
+void Renderer::DecodeTiles(const u8* vram, const u16* tiles, size_t count)
+{
+    const int TILE_SIZE = 16;
+    if(count == 0)
+        return;
+    bool changed[TILE_COUNT] = {};
+    for(size_t i = 0; i < count; i++)
+    {
+        Tiles[tiles[i]].Decode(vram + (tiles[i] * TILE_SIZE));
+        changed[tiles[i]] = true;
+    }
+
+    // redraw wherever the maps use them
+    for(int map = 0; map < 2; map++)
+    {
+        for(int i = 0; i < MAP_TILES; i++)
+        {
+            if(changed[GetBGTile(MapTileSelect[map], MapTiles[map][i])])
+                MapTileValid[map][i] = false;
+        }
+    }
+}
+
+void Renderer::SyncMaps(const u8* vram)
+{
+    for(int map = 0; map < 2; map++)
+    {
+        const u8* tiles = vram + 0x1800 + (map * MAP_TILES);
+        if(std::memcmp(MapTiles[map], tiles, MAP_TILES) == 0)
+            continue;
+        for(int i = 0; i < MAP_TILES; i++)
+        {
+            if(MapTiles[map][i] != tiles[i])
+            {
+                MapTiles[map][i] = tiles[i];
+                MapTileValid[map][i] = false;
+            }
+        }
+    }
+}
+
+const u8* Renderer::GetMapRow(int map, u8 lcdc, u8 y, int x, int count)
+{
+    // only bit 4 changes what gets drawn
+    lcdc &= 0x10;
+    if(MapTileSelect[map] != lcdc)
+    {
+        std::fill(MapTileValid[map], MapTileValid[map] + MAP_TILES, false);
+        MapTileSelect[map] = lcdc;
+    }
+
+    u8* bitmap = &MapBitmaps[map * MAP_SIZE * MAP_SIZE];
+    int tileY = y / 8;
+    // one past the last tile, which can wrap past the right edge
+    int last = (x + count + 7) / 8;
+    for(int tileX = x / 8; tileX < last; tileX++)
+    {
+        int i = (tileY * 32) + (tileX % 32);
+        if(MapTileValid[map][i])
+            continue;
+        const Tile& tile = Tiles[GetBGTile(lcdc, MapTiles[map][i])];
+        u8* dest = bitmap + (tileY * 8 * MAP_SIZE) + ((tileX % 32) * 8);
+        for(int row = 0; row < 8; row++)
+            std::memcpy(dest + (row * MAP_SIZE), tile.rows[row], 8);
+        MapTileValid[map][i] = true;
+    }
+    return bitmap + (y * MAP_SIZE);
+}
+
+void Renderer::DrawMapRow(Color* dest, const u8* row, int x, int count, const Color* palette)
+{
+    while(count > 0)
+    {
+        int run = std::min(count, MAP_SIZE - x);
+        int px = 0;
+        for(; px + 8 <= run; px += 8)
+            ExpandRow(dest + px, row + x + px, palette);
+        for(; px < run; px++)
+            dest[px] = palette[row[x + px]];
+        dest += run;
+        count -= run;
+        x = 0;
+    }
+}
+
+void Renderer::DrawMapRow(u8* dest, const u8* row, int x, int count, const u8* palette)
+{
+    while(count > 0)
+    {
+        int run = std::min(count, MAP_SIZE - x);
+        for(int px = 0; px < run; px++)
+            dest[px] = palette[row[x + px]];
+        dest += run;
+        count -= run;
+        x = 0;
+    }
+}
+
+void Renderer::DrawLines(const u8* vram, const LineRegisters* log, int first, int last,
+                         const LineSplit* splits, size_t splitCount)
+{
+    SyncMaps(vram);
+    size_t split = 0;
+    for(int ly = first; ly < last; ly++)
+    {
+        DrawLine(ly, log[ly], 0);
+        for(; split < splitCount && splits[split].ly == ly; split++)
+            DrawLine(ly, splits[split].regs, splits[split].x);
+        HashRow(ly);
+    }
+}
+
+void Renderer::HashRow(int ly)
+{
+    if(indexed)
+    {
+        Frame<u8>& frame = indexed_frames.GetBack();
+        frame.rowHashes[ly] = HashBytes(&frame.pixels[ly * width], width);
+    }
+    else
+    {
+        Frame<Color>& frame = frames.GetBack();
+        frame.rowHashes[ly] = HashBytes(&frame.pixels[ly * width], width * sizeof(Color));
+    }
+}
+
+void Renderer::DrawLine(int ly, const LineRegisters& regs, int x)
+{
+    for(int palette = 0; palette < 3; palette++)
+    {
+        if(regs.Palettes[palette] != DecodedPalettes[palette])
+            DecodePalette(palette, regs.Palettes[palette]);
+    }
+
+    int features = GetLineFeatures(regs.LCDC);
+    if(indexed)
+        DrawLine(&indexed_frames.GetBack().pixels[ly * width], IndexScratch, IndexScanlines[features],
+                 ly, regs, x, BGIndices, OBJ0Indices, OBJ1Indices);
+    else
+        DrawLine(&frames.GetBack().pixels[ly * width], ColorScratch, ColorScanlines[features],
+                 ly, regs, x, BGPalette, OBJ0Palette, OBJ1Palette);
+}
+
+template<typename Pixel>
+void Renderer::DrawLine(Pixel* line, std::vector<Pixel>& scratch, ScanlineFunc<Pixel> draw,
+                        int ly, const LineRegisters& regs, int x,
+                        const Pixel* bg, const Pixel* obj0, const Pixel* obj1)
+{
+    if(x == 0)
+    {
+        (this->*draw)(line, ly, regs, bg, obj0, obj1);
+        return;
+    }
+    (this->*draw)(scratch.data(), ly, regs, bg, obj0, obj1);
+    std::copy(scratch.begin() + x, scratch.end(), line + x);
+}
+
+void Renderer::Publish()
+{
+    if(indexed)
+        indexed_frames.Publish();
+    else
+        frames.Publish();
+}
+
+const Renderer::ScanlineFunc<Color> Renderer::ColorScanlines[LINE_FEATURES] =
+{
+    &Renderer::DrawScanline<Color, 0>, &Renderer::DrawScanline<Color, 1>,
+    &Renderer::DrawScanline<Color, 2>, &Renderer::DrawScanline<Color, 3>,
+    &Renderer::DrawScanline<Color, 4>, &Renderer::DrawScanline<Color, 5>,
+    &Renderer::DrawScanline<Color, 6>, &Renderer::DrawScanline<Color, 7>
+};
+
+const Renderer::ScanlineFunc<u8> Renderer::IndexScanlines[LINE_FEATURES] =
+{
+    &Renderer::DrawScanline<u8, 0>, &Renderer::DrawScanline<u8, 1>,
+    &Renderer::DrawScanline<u8, 2>, &Renderer::DrawScanline<u8, 3>,
+    &Renderer::DrawScanline<u8, 4>, &Renderer::DrawScanline<u8, 5>,
+    &Renderer::DrawScanline<u8, 6>, &Renderer::DrawScanline<u8, 7>
+};
+
+template<typename Pixel, int Features>
+void Renderer::DrawScanline(Pixel* line, int ly, const LineRegisters& regs,
+                            const Pixel* bg, const Pixel* obj0, const Pixel* obj1)
+{
+    // BG map row this line falls in, wrapping around the 256x256 map
+    u8 mapY = ly + regs.SCY;
+    int map = (regs.LCDC & 0x08)? 1 : 0;
+    const u8* row = GetMapRow(map, regs.LCDC, mapY, regs.SCX, width);
+    DrawMapRow(line, row, regs.SCX, width, bg);
+
+    if((Features & LINE_WINDOW) && ly >= regs.WY) {
+        DrawScanlineWindow(line, ly, regs, bg);
+    }
+    if(Features & LINE_SPRITES) {
+        DrawScanlineSprites<Pixel, (Features & LINE_TALL_SPRITES) != 0>(line, ly, regs, obj0, obj1);
+    }
+}
+
+template<typename Pixel>
+void Renderer::DrawScanlineWindow(Pixel* line, int ly, const LineRegisters& regs, const Pixel* bg)
+{
+    // TODO: Track progress since window drawing
+    // can be stopped and started again at a later LY
+
+    // TODO: It seems I've reached my first impass not
+    // having perfect cycle-count accuracy:
+    // If the window is disabled partway down the screen,
+    // it doesn't draw the last line of the window.
+    // (window is disabled before window finishes drawing)
+    u8 windowY = ly - regs.WY;
+    int map = (regs.LCDC & 0x40)? 1 : 0;
+
+    // WX is offset by 7, anything left of that is offscreen
+    int windowX = std::max(0, 7 - regs.WX);
+    int x = regs.WX + windowX - 7;
+    if(x >= width)
+        return;
+    const u8* row = GetMapRow(map, regs.LCDC, windowY, windowX, width - x);
+    DrawMapRow(line + x, row, windowX, width - x, bg);
+}
+
+template<typename Pixel, bool TallSprites>
+void Renderer::DrawScanlineSprites(Pixel* line, int ly, const LineRegisters& regs,
+                                   const Pixel* obj0, const Pixel* obj1)
+{
+    const int SPRITE_HEIGHT = TallSprites? 16 : 8;
+
+    for(int i = 0; i < regs.SpriteCount; i++)
+    {
+        const Sprite& sprite = regs.Sprites[i];
+        // offset by 16 to align with Sprite y
+        int spriteY = (ly + 16) - sprite._y;
+        // the size changed after the sprites were fetched
+        if(spriteY >= SPRITE_HEIGHT)
+            continue;
+        int oamY = (sprite.flipY)? ((SPRITE_HEIGHT - 1) - spriteY) : spriteY;
+        // 8x16 sprites run on into the next tile
+        const u8* row = Tiles[sprite.id + (oamY / 8)].rows[oamY % 8];
+        const Pixel* palette = (sprite.palette == 0)? obj0 : obj1;
+
+        // sprites start at x 8 so they can scroll in,
+        // only the onscreen part of the row is drawn
+        int x = sprite._x - 8;
+        int first = std::max(0, -x);
+        int last = std::min(8, width - x);
+        if(sprite.flipX)
+            DrawSpriteRow<Pixel, true>(line + x + first, row, first, last, palette);
+        else
+            DrawSpriteRow<Pixel, false>(line + x + first, row, first, last, palette);
+    }
+}
+
+}; // namespace Graphics
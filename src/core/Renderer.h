@@ -0,0 +1,253 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#pragma once
+
+#include "TileKernels.h"
+#include "TripleBuffer.h"
+
+#include "../common/Types.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace Graphics {
+    struct Tile
+    {
+        // one palette index per pixel,
+        // 8 bytes per row for 8 rows
+        u8 rows[8][8];
+
+        inline void Decode(const u8* src)
+        {
+            DecodeTile(src, rows[0]);
+        }
+
+        inline const u8 GetPixel(u8 x, u8 y) const
+        {
+            return rows[y][x];
+        }
+    };
+
+    struct Sprite
+    {
+        u8 _y;
+        u8 _x;
+        u8 id;
+        u8 priority;
+        bool flipY;
+        bool flipX;
+        u8 palette;
+
+        inline void Decode(const u8* src)
+        {
+            _y = src[0];
+            _x = src[1];
+            id = src[2];
+            priority = (src[3] & 0b10000000) >> 7;
+            flipY = (src[3] & 0b01000000) != 0;
+            flipX = (src[3] & 0b00100000) != 0;
+            palette = (src[3] & 0b00010000) >> 4;
+        }
+    };
+
+    // Everything a line is drawn with besides VRAM,
+    // as the PPU had it when it got to the line
+    struct LineRegisters
+    {
+        static const int MAX_SPRITES = 10;
+
+        u8 LCDC;
+        u8 SCY, SCX;
+        u8 WY, WX;
+        // BGP, OBP0 and OBP1
+        u8 Palettes[3];
+        // copied so OAM writes after the line don't affect it
+        int SpriteCount;
+        Sprite Sprites[MAX_SPRITES];
+    };
+
+    // A register write partway through a line: from pixel x
+    // on, line ly is drawn with regs instead
+    struct LineSplit
+    {
+        int ly;
+        int x;
+        LineRegisters regs;
+    };
+
+    // A finished frame. Each row's hash lets the frontend
+    // tell which rows changed from the last frame it showed
+    template<typename Pixel>
+    struct Frame
+    {
+        std::vector<Pixel> pixels;
+        std::vector<u64> rowHashes;
+
+        Frame(int width, int height)
+        :   pixels (width * height),
+            rowHashes (height)
+        {
+        }
+    };
+
+// Draws logged lines into the frames the frontend presents.
+// All it reads is the VRAM it's handed, so it can
+// run on the PPU's thread or on a RenderThread
+class Renderer
+{
+public:
+    // In indexed mode each pixel is a PixelIndex, the shade
+    // after the palette is applied and which palette it came from
+    enum PixelIndex : u8
+    {
+        INDEX_SHADE = 0x03,
+        INDEX_BG = 0x00,
+        INDEX_OBJ0 = 0x04,
+        INDEX_OBJ1 = 0x08,
+        INDEX_PALETTE = 0x0C
+    };
+
+    // Every tile in 0x8000-0x97FF. Sprites use the first
+    // 256, and LCDC bit 4 picks which 256 the BG uses
+    static const int TILE_COUNT = 384;
+
+private:
+    std::vector<Tile> Tiles;
+
+    // Palettes as of the line being drawn
+    u8 DecodedPalettes[3];
+    Color BGPalette[4];
+    Color OBJ0Palette[4];
+    Color OBJ1Palette[4];
+    // The same palettes as PixelIndex values
+    u8 BGIndices[4];
+    u8 OBJ0Indices[4];
+    u8 OBJ1Indices[4];
+    void DecodePalette(int palette, u8 data);
+
+    int width;
+    int height;
+
+    // Only the set for the current mode is allocated
+    bool indexed;
+    TripleBuffer<Frame<Color>> frames;
+    TripleBuffer<Frame<u8>> indexed_frames;
+
+    inline int GetBGTile(u8 lcdc, u8 id)
+    {
+        // with bit 4 clear, tiles 00-7F are at 0x9000
+        return ((lcdc & 0x10) || id >= 128)? id : id + 256;
+    }
+
+    // The two 32x32 tile maps (0x9800 and 0x9C00) drawn out as
+    // 256x256 bitmaps of palette indices, so a BG or window line
+    // is just a copy out of one. Tiles are drawn into them when a
+    // line first needs them, and redrawn once their map entry or
+    // tile data changes, or LCDC bit 4 flips
+    static const int MAP_SIZE = 256;
+    static const int MAP_TILES = 32 * 32;
+    std::vector<u8> MapBitmaps;
+    // The maps as the bitmaps were drawn from them
+    u8 MapTiles[2][MAP_TILES];
+    bool MapTileValid[2][MAP_TILES];
+    // LCDC bit 4 as each bitmap was drawn with
+    u8 MapTileSelect[2];
+    // Picks up map writes since the last call
+    void SyncMaps(const u8* vram);
+    // Row y of a map's bitmap, drawing any tiles under [x, x + count) first
+    const u8* GetMapRow(int map, u8 lcdc, u8 y, int x, int count);
+    // Draws count pixels of a bitmap row from x on, wrapping around
+    void DrawMapRow(Color* dest, const u8* row, int x, int count, const Color* palette);
+    void DrawMapRow(u8* dest, const u8* row, int x, int count, const u8* palette);
+
+    // The LCDC bits that decide what a line draws. There's a
+    // DrawScanline for each combination, so none of them are
+    // tested while drawing; the line's LCDC picks one from a table
+    enum LineFeatures
+    {
+        LINE_WINDOW = 0x01,
+        LINE_SPRITES = 0x02,
+        LINE_TALL_SPRITES = 0x04,
+        LINE_FEATURES = 8
+    };
+    static inline int GetLineFeatures(u8 lcdc)
+    {
+        // sprite enable and size are LCDC bits 1 and 2 already
+        return ((lcdc & 0x20)? LINE_WINDOW : 0) | (lcdc & (LINE_SPRITES | LINE_TALL_SPRITES));
+    }
+
+    // Both framebuffer formats share the drawing code
+    template<typename Pixel>
+    using ScanlineFunc = void (Renderer::*)(Pixel* line, int ly, const LineRegisters& regs,
+                                            const Pixel* bg, const Pixel* obj0, const Pixel* obj1);
+    static const ScanlineFunc<Color> ColorScanlines[LINE_FEATURES];
+    static const ScanlineFunc<u8> IndexScanlines[LINE_FEATURES];
+
+    // Split lines are drawn again in here, then
+    // the pixels after the split copied over
+    std::vector<Color> ColorScratch;
+    std::vector<u8> IndexScratch;
+    // Draws pixels [x, width) of a line
+    void DrawLine(int ly, const LineRegisters& regs, int x);
+    template<typename Pixel>
+    void DrawLine(Pixel* line, std::vector<Pixel>& scratch, ScanlineFunc<Pixel> draw,
+                  int ly, const LineRegisters& regs, int x,
+                  const Pixel* bg, const Pixel* obj0, const Pixel* obj1);
+    // Hashes a finished row of the back frame
+    void HashRow(int ly);
+
+    template<typename Pixel, int Features>
+    void DrawScanline(Pixel* line, int ly, const LineRegisters& regs,
+                      const Pixel* bg, const Pixel* obj0, const Pixel* obj1);
+    template<typename Pixel>
+    void DrawScanlineWindow(Pixel* line, int ly, const LineRegisters& regs, const Pixel* bg);
+    template<typename Pixel, bool TallSprites>
+    void DrawScanlineSprites(Pixel* line, int ly, const LineRegisters& regs,
+                             const Pixel* obj0, const Pixel* obj1);
+    // Draws pixels [first, last) of an 8 pixel sprite row
+    // to dest onwards, 0 is transparent
+    template<typename Pixel, bool FlipX>
+    static inline void DrawSpriteRow(Pixel* dest, const u8* row, int first, int last, const Pixel* palette)
+    {
+        for(int px = first; px < last; px++)
+        {
+            u8 color = row[FlipX? (7 - px) : px];
+            if(color != 0x00)
+                dest[px - first] = palette[color];
+        }
+    }
+
+public:
+    Renderer(int width, int height, bool indexed);
+
+    // Re-decodes count tiles, by index, from vram
+    void DecodeTiles(const u8* vram, const u16* tiles, size_t count);
+    // Draws lines [first, last) of the log into the back buffer,
+    // then redraws the splits (in line order) over them
+    void DrawLines(const u8* vram, const LineRegisters* log, int first, int last,
+                   const LineSplit* splits = nullptr, size_t splitCount = 0);
+    // Hands the drawn frame over to the frontend
+    void Publish();
+
+    TripleBuffer<Frame<Color>>& GetFrames()
+        { return frames; }
+    TripleBuffer<Frame<u8>>& GetIndexedFrames()
+        { return indexed_frames; }
+};
+
+}; // namespace Graphics
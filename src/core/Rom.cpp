@@ -25,11 +25,22 @@ namespace Core {
 
 Rom::Rom(const std::vector<u8>& bytes, int force_mbc)
 :
-    bytes (bytes)
+    header (ParseHeader(bytes)),
+    bytes (RomRegistry::Acquire(bytes))
 {
+    LOG_MSG("Loaded rom: " + std::string(header.Name));
+    if(force_mbc != -1)
+        header.CartType = force_mbc;
+}
+
+Rom::Header Rom::ParseHeader(const std::vector<u8>& bytes)
+{
+    if(bytes.size() < 0x150)
+        throw std::out_of_range("ROM is too small to have a header!");
+
+    Header header = {};
     // copy the rom name (in newer carts the end of this is used by manufacturer code)
     std::copy(bytes.begin() + 0x134, bytes.begin() + 0x143, header.Name);
-    LOG_MSG("Loaded rom: " + std::string(header.Name));
     // copy the new manufacturer code
     std::copy(bytes.begin() + 0x13F, bytes.begin() + 0x143, header.Manufacturer);
     header.UsesSGBFeatures = bytes.at(0x146) == 0x03; // 3 means yes, 0 means no
@@ -37,7 +48,11 @@ Rom::Rom(const std::vector<u8>& bytes, int force_mbc)
     header.RamSize = bytes.at(0x149);
     header.International = bytes.at(0x14A) == 0x01; // 00 means Japan, 01 means international
     header.Licensee = bytes.at(0x14B); // if 33, SGB functions don't work
+    header.NewLicensee[0] = bytes.at(0x144);
+    header.NewLicensee[1] = bytes.at(0x145);
     header.VersionCode = bytes.at(0x14C); // usually 00
+    header.HeaderChecksum = bytes.at(0x14D);
+    header.GlobalChecksum = (bytes.at(0x14E) << 8) | bytes.at(0x14F); // big endian
 
     // Cart Type specifies which MBC type is used in the cart,
     // and what external hardware (i.e. battery) is included.
@@ -58,8 +73,62 @@ Rom::Rom(const std::vector<u8>& bytes, int force_mbc)
     //     11 - MBC3                            FD - BANDAI TAMA5
     //     12 - MBC3 + RAM                      FE - HuC3
     //     13 - MBC3 + RAM + BATTERY            FF - HuC1 + RAM + BATTERY
-    header.CartType = (force_mbc == -1)? bytes.at(0x147) : force_mbc;
-    //LOG_MSG("Cart type " + header.CartType);
+    header.CartType = bytes.at(0x147);
+    return header;
+}
+
+bool Rom::CheckHeaderChecksum(const std::vector<u8>& bytes)
+{
+    u8 sum = 0;
+    for(u16 i = 0x134; i <= 0x14C; i++)
+        sum = sum - bytes.at(i) - 1;
+    return sum == bytes.at(0x14D);
+}
+
+bool Rom::CheckGlobalChecksum(const std::vector<u8>& bytes)
+{
+    u16 sum = 0;
+    for(size_t i = 0; i < bytes.size(); i++)
+    {
+        if(i != 0x14E && i != 0x14F)
+            sum += bytes[i];
+    }
+    return sum == ((bytes.at(0x14E) << 8) | bytes.at(0x14F));
+}
+
+bool Rom::CartHasBattery(u8 cartType)
+{
+    switch(cartType)
+    {
+    case 0x03: case 0x06: case 0x09: case 0x0D:
+    case 0x0F: case 0x10: case 0x13: case 0x17:
+    case 0x1B: case 0x1E: case 0x22: case 0xFF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Rom::CartHasTimer(u8 cartType)
+{
+    return cartType == 0x0F || cartType == 0x10;
+}
+
+u32 Rom::DecodeRAMSize(u8 ramSize)
+{
+    // RAM Size specifies how much external RAM is in the cart:
+    //     00 - None                            03 - 32KB (4 banks)
+    //     01 - 2KB                             04 - 128KB (16 banks)
+    //     02 - 8KB                             05 - 64KB (8 banks)
+    switch(ramSize)
+    {
+    case 0x01: return 0x00800;
+    case 0x02: return 0x02000;
+    case 0x03: return 0x08000;
+    case 0x04: return 0x20000;
+    case 0x05: return 0x10000;
+    default:   return 0;
+    }
 }
 
 }; // namespace Core
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include "RomRegistry.h"
+
 #include "../common/Types.h"
 
 #include <vector>
@@ -25,6 +27,7 @@ class GameBoy;
 
 class Rom
 {
+public:
     struct Header
     {
         char Name[16];
@@ -35,16 +38,25 @@ class Rom
         u8 RamSize;
         bool International;
         u8 Licensee;
+        // only used when Licensee is 0x33
+        char NewLicensee[2];
         u8 VersionCode;
+        u8 HeaderChecksum;
+        u16 GlobalChecksum;
     };
+
+private:
     Header header;
-    // all bytes in the ROM
-    std::vector<u8> bytes;
+    // all bytes in the ROM, shared with every
+    // other instance running the same ROM
+    RomRegistry::Image bytes;
 
 public:
     Rom(const std::vector<u8>& bytes, int force_mbc);
 
-    std::vector<u8>& GetBytes()
+    const std::vector<u8>& GetBytes()
+        { return *bytes; }
+    RomRegistry::Image& GetImage()
         { return bytes; }
 
     char* GetRomName()
@@ -53,6 +65,29 @@ public:
         { return header.CartType; }
     u8 GetROMSize()
         { return header.RomSize; }
+    u8 GetRAMSize()
+        { return header.RamSize; }
+    // Decodes the header's RAM size into bytes
+    u32 GetRAMBytes()
+        { return DecodeRAMSize(header.RamSize); }
+    // Whether the cart keeps its RAM with a battery
+    bool HasBattery()
+        { return CartHasBattery(header.CartType); }
+    // Whether the cart has an MBC3 real time clock
+    bool HasTimer()
+        { return CartHasTimer(header.CartType); }
+
+    // These work on raw images, so ROMs can be inspected
+    // without loading them into an instance.
+    // throws std::out_of_range if bytes is too small to have a header
+    static Header ParseHeader(const std::vector<u8>& bytes);
+    // Checksum of 0x0134-0x014C, the boot ROM locks up if it's wrong
+    static bool CheckHeaderChecksum(const std::vector<u8>& bytes);
+    // Sum of every byte but the checksum itself, never checked by hardware
+    static bool CheckGlobalChecksum(const std::vector<u8>& bytes);
+    static u32 DecodeRAMSize(u8 ramSize);
+    static bool CartHasBattery(u8 cartType);
+    static bool CartHasTimer(u8 cartType);
 };
 
 }; // namespace Core
@@ -0,0 +1,217 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "RomFile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+
+namespace Core {
+namespace RomFile {
+
+// Compressed input is read this much at a time
+static const u32 CHUNK_SIZE = 0x10000;
+
+static bool EndsWith(const std::string& str, const std::string& suffix)
+{
+    return str.length() >= suffix.length() &&
+           str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+bool IsRomPath(const std::string& path)
+{
+    return EndsWith(path, ".gb") || EndsWith(path, ".gb.gz") || EndsWith(path, ".zip");
+}
+
+std::string StripExtension(const std::string& path)
+{
+    for(const char* ext : { ".gb.gz", ".gb", ".zip" })
+    {
+        if(EndsWith(path, ext))
+            return path.substr(0, path.length() - std::string(ext).length());
+    }
+    return path;
+}
+
+// zip and gzip are both little endian
+static u32 ReadLE(const u8* bytes, int size)
+{
+    u32 value = 0;
+    for(int i = size - 1; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void ReadAt(std::ifstream& file, u32 offset, u8* bytes, u32 size)
+{
+    file.seekg(offset, std::ios_base::beg);
+    file.read(reinterpret_cast<char*>(bytes), size);
+    if(!file.good())
+        throw std::runtime_error("Unexpected end of ROM file!");
+}
+
+// Inflates compressedSize bytes from the file's current position
+// into rom, which must already be sized to fit all of it.
+// windowBits picks gzip (16+) or raw deflate (negative) streams
+static void Inflate(std::ifstream& file, u32 compressedSize, int windowBits, std::vector<u8>& rom)
+{
+    z_stream stream = {};
+    if(inflateInit2(&stream, windowBits) != Z_OK)
+        throw std::runtime_error("Error initializing zlib!");
+
+    // on the heap, this also runs on the indexer's threads
+    std::vector<u8> chunk (CHUNK_SIZE);
+    stream.next_out = rom.data();
+    stream.avail_out = rom.size();
+    int result = Z_OK;
+    while(result != Z_STREAM_END && compressedSize > 0)
+    {
+        u32 size = std::min(compressedSize, CHUNK_SIZE);
+        file.read(reinterpret_cast<char*>(chunk.data()), size);
+        if(!file.good())
+            break;
+        compressedSize -= size;
+
+        stream.next_in = chunk.data();
+        stream.avail_in = size;
+        result = inflate(&stream, Z_NO_FLUSH);
+        if(result != Z_OK && result != Z_STREAM_END)
+            break;
+        // out of room with input left over
+        if(result == Z_OK && stream.avail_out == 0 && stream.avail_in != 0)
+            break;
+    }
+    u32 total = stream.total_out;
+    inflateEnd(&stream);
+
+    if(result != Z_STREAM_END || total != rom.size())
+        throw std::runtime_error("Corrupt compressed ROM!");
+}
+
+static void LoadGzip(std::ifstream& file, u32 fileSize, std::vector<u8>& rom)
+{
+    // The last 4 bytes are the uncompressed size,
+    // so the buffer can be allocated up front
+    u8 trailer[4];
+    if(fileSize < 18)
+        throw std::runtime_error("Corrupt compressed ROM!");
+    ReadAt(file, fileSize - 4, trailer, 4);
+    u32 size = ReadLE(trailer, 4);
+    if(size > MAX_ROM_SIZE)
+        throw std::runtime_error("ROM is too large!");
+
+    rom.resize(size);
+    file.seekg(0, std::ios_base::beg);
+    Inflate(file, fileSize, 16 + MAX_WBITS, rom);
+}
+
+static void LoadZip(std::ifstream& file, u32 fileSize, std::vector<u8>& rom)
+{
+    // Find the end of central directory record,
+    // it's followed by at most a 64KB comment
+    u32 tailSize = std::min<u32>(fileSize, 0x10000 + 22);
+    std::vector<u8> tail (tailSize);
+    ReadAt(file, fileSize - tailSize, tail.data(), tailSize);
+    int end = -1;
+    for(int i = tailSize - 22; i >= 0; i--)
+    {
+        if(ReadLE(&tail[i], 4) == 0x06054B50)
+        {
+            end = i;
+            break;
+        }
+    }
+    if(end < 0)
+        throw std::runtime_error("Not a zip file!");
+
+    u32 entries = ReadLE(&tail[end + 10], 2);
+    u32 offset = ReadLE(&tail[end + 16], 4);
+    // the first .gb in the archive is the one that's loaded
+    for(u32 i = 0; i < entries; i++)
+    {
+        u8 header[46];
+        ReadAt(file, offset, header, sizeof(header));
+        if(ReadLE(header, 4) != 0x02014B50)
+            break;
+        u32 method = ReadLE(header + 10, 2);
+        u32 crc = ReadLE(header + 16, 4);
+        u32 compressedSize = ReadLE(header + 20, 4);
+        u32 size = ReadLE(header + 24, 4);
+        u32 nameLength = ReadLE(header + 28, 2);
+        u32 extraLength = ReadLE(header + 30, 2);
+        u32 commentLength = ReadLE(header + 32, 2);
+        u32 localOffset = ReadLE(header + 42, 4);
+
+        std::string name (nameLength, '\0');
+        ReadAt(file, offset + sizeof(header), reinterpret_cast<u8*>(&name[0]), nameLength);
+        offset += sizeof(header) + nameLength + extraLength + commentLength;
+        if(!EndsWith(name, ".gb"))
+            continue;
+
+        if(size > MAX_ROM_SIZE)
+            throw std::runtime_error("ROM is too large!");
+        if(method != 0 && method != Z_DEFLATED)
+            throw std::runtime_error("Unsupported zip compression method!");
+
+        // The local header's name and extra field
+        // can differ in length from the central one's
+        u8 local[30];
+        ReadAt(file, localOffset, local, sizeof(local));
+        if(ReadLE(local, 4) != 0x04034B50)
+            throw std::runtime_error("Corrupt zip file!");
+        file.seekg(localOffset + sizeof(local) + ReadLE(local + 26, 2) + ReadLE(local + 28, 2));
+
+        rom.resize(size);
+        if(method == 0)
+        {
+            file.read(reinterpret_cast<char*>(rom.data()), size);
+            if(!file.good() || compressedSize != size)
+                throw std::runtime_error("Corrupt zip file!");
+        }
+        else
+            Inflate(file, compressedSize, -MAX_WBITS, rom);
+
+        if(crc32(0, rom.data(), size) != crc)
+            throw std::runtime_error("ROM failed its zip CRC check!");
+        return;
+    }
+    throw std::runtime_error("No .gb file in zip!");
+}
+
+void Load(const std::string& path, std::vector<u8>& rom)
+{
+    std::ifstream file (path, std::ios::binary | std::ios::ate);
+    if(!file.good())
+        throw std::runtime_error("Error opening ROM!");
+    u32 fileSize = file.tellg();
+
+    if(EndsWith(path, ".gb.gz"))
+        LoadGzip(file, fileSize, rom);
+    else if(EndsWith(path, ".zip"))
+        LoadZip(file, fileSize, rom);
+    else
+    {
+        if(fileSize > MAX_ROM_SIZE)
+            throw std::runtime_error("ROM is too large!");
+        rom.resize(fileSize);
+        ReadAt(file, 0, rom.data(), fileSize);
+    }
+}
+
+}; // namespace RomFile
+}; // namespace Core
@@ -0,0 +1,41 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../common/Types.h"
+
+#include <string>
+#include <vector>
+
+
+namespace Core {
+
+// Reads ROMs off disk, either plain (.gb) or compressed
+// (.gb.gz, or the first .gb in a .zip). Compressed ROMs
+// are inflated as they're read, straight into the ROM buffer
+namespace RomFile {
+    // Largest ROM any cart supports (MBC5, 512 banks)
+    const u32 MAX_ROM_SIZE = 0x800000;
+
+    // Whether path ends in an extension we can load
+    bool IsRomPath(const std::string& path);
+    // path without its ROM extension, for naming saves
+    std::string StripExtension(const std::string& path);
+    // throws std::runtime_error if the file can't be read
+    void Load(const std::string& path, std::vector<u8>& rom);
+}; // namespace RomFile
+
+}; // namespace Core
@@ -0,0 +1,244 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "RomIndex.h"
+#include "Rom.h"
+#include "RomFile.h"
+
+#include "../common/Hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace Core {
+
+static_assert(sizeof(RomIndex::Entry) == 48, "RomIndex::Entry must stay packed");
+
+// Symlinks are followed, so directories already visited
+// are skipped to keep a link loop from recursing forever
+typedef std::set<std::pair<dev_t, ino_t>> VisitedDirs;
+
+static void FindRoms(const std::string& directory, std::vector<std::string>& roms,
+                     VisitedDirs& visited)
+{
+    struct stat self;
+    if(stat(directory.c_str(), &self) < 0 ||
+       !visited.insert(std::make_pair(self.st_dev, self.st_ino)).second)
+        return;
+
+    DIR* dir = opendir(directory.c_str());
+    if(!dir)
+        return;
+
+    while(dirent* child = readdir(dir))
+    {
+        std::string name (child->d_name);
+        if(name == "." || name == "..")
+            continue;
+
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if(stat(path.c_str(), &info) < 0)
+            continue;
+        if(S_ISDIR(info.st_mode))
+            FindRoms(path, roms, visited);
+        else if(S_ISREG(info.st_mode) && RomFile::IsRomPath(path))
+            roms.push_back(path);
+    }
+    closedir(dir);
+}
+
+// Returns false if the file can't be read or isn't a ROM.
+// Compressed ROMs are hashed by their uncompressed contents
+static bool IndexRom(const std::string& path, RomIndex::Entry& entry)
+{
+    std::vector<u8> bytes;
+    Rom::Header header;
+    try
+    {
+        RomFile::Load(path, bytes);
+        header = Rom::ParseHeader(bytes);
+    }
+    catch(std::runtime_error& e)
+    {
+        return false;
+    }
+    catch(std::out_of_range& e)
+    {
+        return false;
+    }
+
+    entry = {};
+    entry.hash = HashBytes(bytes.data(), bytes.size());
+    entry.size = bytes.size();
+    entry.ramBytes = Rom::DecodeRAMSize(header.RamSize);
+    entry.globalChecksum = header.GlobalChecksum;
+    std::memcpy(entry.name, header.Name, sizeof(entry.name));
+    entry.cartType = header.CartType;
+    entry.romSize = header.RomSize;
+    entry.ramSize = header.RamSize;
+    entry.licensee = header.Licensee;
+    std::memcpy(entry.newLicensee, header.NewLicensee, sizeof(entry.newLicensee));
+    if(Rom::CheckHeaderChecksum(bytes))
+        entry.flags |= RomIndex::HEADER_CHECKSUM_OK;
+    if(Rom::CheckGlobalChecksum(bytes))
+        entry.flags |= RomIndex::GLOBAL_CHECKSUM_OK;
+    return true;
+}
+
+u32 RomIndex::Build(const std::string& directory, const std::string& path, unsigned threads)
+{
+    std::vector<std::string> roms;
+    VisitedDirs visited;
+    FindRoms(directory, roms, visited);
+    // so the same library always gives the same index
+    std::sort(roms.begin(), roms.end());
+
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, std::max<size_t>(1, roms.size()));
+
+    // Each worker takes the next unclaimed ROM,
+    // and only ever writes to that ROM's slot
+    std::vector<Entry> results (roms.size());
+    std::vector<u8> valid (roms.size());
+    std::atomic<size_t> next (0);
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread([&]() {
+            for(size_t rom = next++; rom < roms.size(); rom = next++)
+                valid[rom] = IndexRom(roms[rom], results[rom]);
+        }));
+    }
+    for(auto& worker : workers)
+        worker.join();
+
+    std::vector<Entry> entries;
+    std::string paths;
+    for(size_t rom = 0; rom < roms.size(); rom++)
+    {
+        if(!valid[rom] || roms[rom].length() > 0xFFFF)
+            continue;
+        Entry& entry = results[rom];
+        entry.pathOffset = paths.length();
+        entry.pathLength = roms[rom].length();
+        paths += roms[rom];
+        entries.push_back(entry);
+    }
+    // stable, so duplicates stay in path order
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.hash < b.hash;
+    });
+
+    FileHeader header = {};
+    std::memcpy(header.magic, "JXRI", 4);
+    header.version = VERSION;
+    header.count = entries.size();
+    header.pathsOffset = sizeof(FileHeader) + entries.size() * sizeof(Entry);
+
+    std::ofstream file (path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+    file.write(paths.data(), paths.length());
+    if(!file.good())
+        throw std::runtime_error("Error writing ROM index " + path);
+
+    return header.count;
+}
+
+RomIndex::RomIndex(const std::string& path)
+:   fd(-1),
+    size(0),
+    bytes(nullptr)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Error opening ROM index " + path);
+
+    struct stat info;
+    if(fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(FileHeader))
+    {
+        close(fd);
+        throw std::runtime_error("Not a ROM index " + path);
+    }
+    size = info.st_size;
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("Error mapping ROM index " + path);
+    }
+    bytes = static_cast<const u8*>(mapping);
+
+    header = reinterpret_cast<const FileHeader*>(bytes);
+    entries = reinterpret_cast<const Entry*>(bytes + sizeof(FileHeader));
+    paths = reinterpret_cast<const char*>(bytes + header->pathsOffset);
+    if(std::memcmp(header->magic, "JXRI", 4) != 0 || header->version != VERSION ||
+       header->pathsOffset != sizeof(FileHeader) + header->count * sizeof(Entry) ||
+       header->pathsOffset > size)
+    {
+        munmap(const_cast<u8*>(bytes), size);
+        close(fd);
+        throw std::runtime_error("Not a ROM index " + path);
+    }
+
+    // A truncated or corrupt index could point paths past the mapping
+    size_t pathsSize = size - header->pathsOffset;
+    for(u32 i = 0; i < header->count; i++)
+    {
+        if(static_cast<size_t>(entries[i].pathOffset) + entries[i].pathLength > pathsSize)
+        {
+            munmap(const_cast<u8*>(bytes), size);
+            close(fd);
+            throw std::runtime_error("Corrupt ROM index " + path);
+        }
+    }
+}
+
+RomIndex::~RomIndex()
+{
+    munmap(const_cast<u8*>(bytes), size);
+    close(fd);
+}
+
+// Lets equal_range search the entries by hash alone
+struct HashLess
+{
+    bool operator()(const RomIndex::Entry& entry, u64 hash) const
+        { return entry.hash < hash; }
+    bool operator()(u64 hash, const RomIndex::Entry& entry) const
+        { return hash < entry.hash; }
+};
+
+std::pair<const RomIndex::Entry*, const RomIndex::Entry*> RomIndex::Find(u64 hash)
+{
+    return std::equal_range(entries, entries + header->count, hash, HashLess());
+}
+
+}; // namespace Core
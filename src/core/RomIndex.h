@@ -0,0 +1,101 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../common/Types.h"
+
+#include <string>
+#include <utility>
+
+
+namespace Core {
+
+// A prebuilt index of a ROM library, so the headers of
+// thousands of ROMs can be looked up without opening them.
+//
+// The file is the header below, the entries sorted by
+// content hash, then the (unterminated) paths they point into.
+// It's read by mapping it straight into memory
+class RomIndex
+{
+public:
+    enum EntryFlags
+    {
+        HEADER_CHECKSUM_OK = 0x01,
+        GLOBAL_CHECKSUM_OK = 0x02
+    };
+
+    struct Entry
+    {
+        // HashBytes of the whole file
+        u64 hash;
+        u32 size;
+        u32 ramBytes;
+        // into the path table
+        u32 pathOffset;
+        u16 pathLength;
+        u16 globalChecksum;
+        char name[16];
+        u8 cartType;
+        u8 romSize;
+        u8 ramSize;
+        u8 licensee;
+        char newLicensee[2];
+        u8 flags;
+        u8 reserved;
+    };
+
+    struct FileHeader
+    {
+        char magic[4];
+        u32 version;
+        u32 count;
+        u32 pathsOffset;
+    };
+
+    // 2 changed how the content hash is worked out
+    static const u32 VERSION = 2;
+
+    // Indexes every ROM under directory using up to
+    // threads workers (0 for one per core) and writes
+    // the index to path. Returns how many were indexed.
+    // throws std::runtime_error if the index can't be written
+    static u32 Build(const std::string& directory, const std::string& path, unsigned threads);
+
+    // throws std::runtime_error if the file isn't a valid index
+    RomIndex(const std::string& path);
+    ~RomIndex();
+
+    u32 GetCount()
+        { return header->count; }
+    const Entry& GetEntry(u32 index)
+        { return entries[index]; }
+    std::string GetPath(const Entry& entry)
+        { return std::string(paths + entry.pathOffset, entry.pathLength); }
+    // Every entry with a matching hash, [first, second)
+    std::pair<const Entry*, const Entry*> Find(u64 hash);
+
+private:
+    int fd;
+    size_t size;
+    const u8* bytes;
+
+    const FileHeader* header;
+    const Entry* entries;
+    const char* paths;
+};
+
+}; // namespace Core
@@ -0,0 +1,79 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "RomRegistry.h"
+
+#include "../common/Hash.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+
+namespace Core {
+namespace RomRegistry {
+
+// Instances can be created from any thread
+static std::mutex& GetMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+static std::unordered_multimap<u64, std::weak_ptr<const std::vector<u8>>>& GetImages()
+{
+    static std::unordered_multimap<u64, std::weak_ptr<const std::vector<u8>>> images;
+    return images;
+}
+
+// Images are padded out to whole 16KB banks (and at least
+// two of them) so the MBCs can map banks straight out of them
+static size_t PaddedSize(size_t size)
+{
+    return std::max<size_t>(0x8000, (size + 0x3FFF) & ~size_t(0x3FFF));
+}
+
+Image Acquire(const std::vector<u8>& bytes)
+{
+    u64 hash = HashBytes(bytes.data(), bytes.size());
+    size_t size = PaddedSize(bytes.size());
+
+    std::lock_guard<std::mutex> lock (GetMutex());
+    auto& images = GetImages();
+    auto range = images.equal_range(hash);
+    for(auto it = range.first; it != range.second;)
+    {
+        Image image = it->second.lock();
+        if(!image)
+        {
+            // the last instance using it is gone
+            it = images.erase(it);
+            continue;
+        }
+        // don't trust the hash alone
+        if(image->size() == size && std::equal(bytes.begin(), bytes.end(), image->begin()))
+            return image;
+        it++;
+    }
+
+    std::vector<u8> padded (bytes);
+    padded.resize(size, 0xFF);
+    Image image = std::make_shared<const std::vector<u8>>(std::move(padded));
+    images.emplace(hash, image);
+    return image;
+}
+
+}; // namespace RomRegistry
+}; // namespace Core
@@ -0,0 +1,38 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../common/Types.h"
+
+#include <memory>
+#include <vector>
+
+
+namespace Core {
+
+// Hands out one shared, immutable copy of each ROM,
+// so any number of instances running the same game
+// only keep a single image of it in memory
+namespace RomRegistry {
+    using Image = std::shared_ptr<const std::vector<u8>>;
+
+    // Returns the image matching bytes, making a new
+    // one if no other instance is using it.
+    // Images are freed once the last user drops them
+    Image Acquire(const std::vector<u8>& bytes);
+}; // namespace RomRegistry
+
+}; // namespace Core
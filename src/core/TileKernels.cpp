@@ -0,0 +1,211 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "TileKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+// AVX2 is only compiled in for the functions that use it,
+// so the rest of the binary still runs on any x86 CPU
+#define KERNELS_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+namespace Graphics {
+
+static void DecodeTileScalar(const u8* src, u8* indices)
+{
+    for(int row = 0; row < 8; row++)
+    {
+        u8 lower = src[row * 2];
+        u8 upper = src[(row * 2) + 1];
+        for(int x = 0; x < 8; x++)
+        {
+            int bit = 7 - x;
+            indices[(row * 8) + x] = ((lower >> bit) & 1) | (((upper >> bit) & 1) << 1);
+        }
+    }
+}
+
+static void ExpandRowScalar(Color* dest, const u8* indices, const Color* palette)
+{
+    for(int x = 0; x < 8; x++)
+        dest[x] = palette[indices[x] & 0x03];
+}
+
+#ifdef __SSE2__
+// Spreads the bits of each byte in bytes (already repeated
+// across 8 lanes each) into 0 or value, leftmost pixel first
+static inline __m128i SpreadBits(__m128i bytes, __m128i value)
+{
+    const __m128i bits = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits);
+    return _mm_and_si128(set, value);
+}
+
+static void DecodeTileSSE2(const u8* src, u8* indices)
+{
+    // Split the interleaved rows into the low and high bit planes
+    __m128i tile = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i lower = _mm_packus_epi16(_mm_and_si128(tile, _mm_set1_epi16(0x00FF)), _mm_setzero_si128());
+    __m128i upper = _mm_packus_epi16(_mm_srli_epi16(tile, 8), _mm_setzero_si128());
+    // then repeat each row's byte 8 times, two rows per register
+    lower = _mm_unpacklo_epi8(lower, lower);
+    upper = _mm_unpacklo_epi8(upper, upper);
+    __m128i lower4[2] = { _mm_unpacklo_epi16(lower, lower), _mm_unpackhi_epi16(lower, lower) };
+    __m128i upper4[2] = { _mm_unpacklo_epi16(upper, upper), _mm_unpackhi_epi16(upper, upper) };
+
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    __m128i* dest = reinterpret_cast<__m128i*>(indices);
+    for(int half = 0; half < 2; half++)
+    {
+        __m128i rowsLower[2] = { _mm_unpacklo_epi32(lower4[half], lower4[half]),
+                                 _mm_unpackhi_epi32(lower4[half], lower4[half]) };
+        __m128i rowsUpper[2] = { _mm_unpacklo_epi32(upper4[half], upper4[half]),
+                                 _mm_unpackhi_epi32(upper4[half], upper4[half]) };
+        for(int pair = 0; pair < 2; pair++)
+        {
+            __m128i rows = _mm_or_si128(SpreadBits(rowsLower[pair], one), SpreadBits(rowsUpper[pair], two));
+            _mm_storeu_si128(dest++, rows);
+        }
+    }
+}
+
+static void ExpandRowSSE2(Color* dest, const u8* indices, const Color* palette)
+{
+    // No variable shuffle in SSE2, so select each
+    // palette entry wherever the index matches it
+    __m128i bytes = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)),
+                                  _mm_set1_epi8(0x03));
+    bytes = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+    __m128i halves[2] = { _mm_unpacklo_epi16(bytes, _mm_setzero_si128()),
+                          _mm_unpackhi_epi16(bytes, _mm_setzero_si128()) };
+    for(int half = 0; half < 2; half++)
+    {
+        __m128i colors = _mm_setzero_si128();
+        for(int i = 0; i < 4; i++)
+        {
+            __m128i match = _mm_cmpeq_epi32(halves[half], _mm_set1_epi32(i));
+            colors = _mm_or_si128(colors, _mm_and_si128(match, _mm_set1_epi32(palette[i])));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (half * 4)), colors);
+    }
+}
+#endif
+
+#ifdef KERNELS_AVX2
+KERNELS_AVX2 static void DecodeTileAVX2(const u8* src, u8* indices)
+{
+    // Both lanes get the whole tile, and the shuffles
+    // repeat each row's bytes 8 times, four rows per register
+    __m256i tile = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    for(int half = 0; half < 2; half++)
+    {
+        char row = half * 8;
+        __m256i lowerIndex = _mm256_setr_epi8(
+            row + 0, row + 0, row + 0, row + 0, row + 0, row + 0, row + 0, row + 0,
+            row + 2, row + 2, row + 2, row + 2, row + 2, row + 2, row + 2, row + 2,
+            row + 4, row + 4, row + 4, row + 4, row + 4, row + 4, row + 4, row + 4,
+            row + 6, row + 6, row + 6, row + 6, row + 6, row + 6, row + 6, row + 6);
+        __m256i lower = _mm256_shuffle_epi8(tile, lowerIndex);
+        __m256i upper = _mm256_shuffle_epi8(tile, _mm256_add_epi8(lowerIndex, one));
+
+        __m256i lowerSet = _mm256_cmpeq_epi8(_mm256_and_si256(lower, bits), bits);
+        __m256i upperSet = _mm256_cmpeq_epi8(_mm256_and_si256(upper, bits), bits);
+        __m256i rows = _mm256_or_si256(_mm256_and_si256(lowerSet, one), _mm256_and_si256(upperSet, two));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(indices + (half * 32)), rows);
+    }
+}
+
+KERNELS_AVX2 static void ExpandRowAVX2(Color* dest, const u8* indices, const Color* palette)
+{
+    __m256i lookup = _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette)));
+    __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)));
+    index = _mm256_and_si256(index, _mm256_set1_epi32(0x03));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), _mm256_permutevar8x32_epi32(lookup, index));
+}
+#endif
+
+enum KernelSet
+{
+    KERNELS_SCALAR,
+    KERNELS_SSE2,
+    KERNELS_AVX2_SET
+};
+
+static KernelSet DetectKernels()
+{
+#ifdef KERNELS_AVX2
+    // checks CPUID (and that the OS saves the AVX registers)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return KERNELS_AVX2_SET;
+#endif
+#ifdef __SSE2__
+    return KERNELS_SSE2;
+#else
+    return KERNELS_SCALAR;
+#endif
+}
+
+static const KernelSet kernels = DetectKernels();
+
+static void (*PickDecodeTile())(const u8*, u8*)
+{
+    switch(kernels)
+    {
+#ifdef KERNELS_AVX2
+    case KERNELS_AVX2_SET: return DecodeTileAVX2;
+#endif
+#ifdef __SSE2__
+    case KERNELS_SSE2: return DecodeTileSSE2;
+#endif
+    default: return DecodeTileScalar;
+    }
+}
+
+static void (*PickExpandRow())(Color*, const u8*, const Color*)
+{
+    switch(kernels)
+    {
+#ifdef KERNELS_AVX2
+    case KERNELS_AVX2_SET: return ExpandRowAVX2;
+#endif
+#ifdef __SSE2__
+    case KERNELS_SSE2: return ExpandRowSSE2;
+#endif
+    default: return ExpandRowScalar;
+    }
+}
+
+void (*const DecodeTile)(const u8* src, u8* indices) = PickDecodeTile();
+void (*const ExpandRow)(Color* dest, const u8* indices, const Color* palette) = PickExpandRow();
+
+const char* GetKernelName()
+{
+    switch(kernels)
+    {
+    case KERNELS_AVX2_SET: return "AVX2";
+    case KERNELS_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+}; // namespace Graphics
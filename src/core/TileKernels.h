@@ -0,0 +1,36 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../common/Types.h"
+
+
+namespace Graphics {
+
+// The hot per-pixel loops of the PPU, with SSE2 and AVX2
+// versions picked at startup from what the CPU supports.
+// Everything else gets the plain C++ version
+
+// Turns 16 bytes of 2bpp tile data into 64 palette indices, 8 per row
+extern void (*const DecodeTile)(const u8* src, u8* indices);
+// Looks up 8 palette indices in a 4 color palette,
+// only the low 2 bits of each index are used
+extern void (*const ExpandRow)(Color* dest, const u8* indices, const Color* palette);
+
+// "AVX2", "SSE2" or "scalar"
+const char* GetKernelName();
+
+}; // namespace Graphics
@@ -0,0 +1,75 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "../common/Types.h"
+
+#include <atomic>
+
+
+namespace Graphics {
+
+// Hands finished frames from the PPU to the presenter
+// without either side ever waiting on the other.
+//
+// The writer owns the back buffer and the reader the front
+// one. The third buffer sits between them, and each side
+// swaps its own buffer with it in one atomic exchange
+template<typename Frame>
+class TripleBuffer
+{
+    // Set on the middle index while it holds
+    // a frame the reader hasn't taken yet
+    static const u8 FRESH = 0x04;
+    static const u8 INDEX = 0x03;
+
+    Frame buffers[3];
+    u8 back = 0;
+    std::atomic<u8> middle;
+    u8 front = 2;
+
+public:
+    // all three start out as copies of blank
+    TripleBuffer(const Frame& blank)
+    :   buffers { blank, blank, blank },
+        middle(1)
+    {
+    }
+
+    // Writer side
+    Frame& GetBack()
+        { return buffers[back]; }
+    // Makes the back buffer the latest frame. The new
+    // back buffer still has an older frame in it
+    void Publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader side, false if there's no new frame
+    // since the last call (the front buffer is kept)
+    bool Acquire()
+    {
+        if(!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const Frame& GetFront()
+        { return buffers[front]; }
+};
+
+}; // namespace Graphics
@@ -0,0 +1,48 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "AccessProfile.h"
+
+#include <fstream>
+
+
+namespace Memory {
+
+void AccessProfile::Count(AccessType type, u16 address, int romBank, int ramBank)
+{
+    granules[type][address / GRANULE_SIZE]++;
+
+    if(address >= 0x4000 && address <= 0x7FFF)
+        romBanks[type][romBank % ROM_BANKS]++;
+    else if(address >= 0xA000 && address <= 0xBFFF)
+        ramBanks[type][ramBank % RAM_BANKS]++;
+}
+
+bool AccessProfile::Save(const std::string& path)
+{
+    std::ofstream file (path, std::ios::binary);
+    if(!file.good())
+        return false;
+
+    const u32 header[4] = { 1, GRANULES, ROM_BANKS, RAM_BANKS };
+    file.write("JXHM", 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(granules), sizeof(granules));
+    file.write(reinterpret_cast<const char*>(romBanks), sizeof(romBanks));
+    file.write(reinterpret_cast<const char*>(ramBanks), sizeof(ramBanks));
+
+    return file.good();
+}
+
+}; // namespace Memory
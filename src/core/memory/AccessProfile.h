@@ -0,0 +1,57 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "../../common/Types.h"
+
+#include <string>
+
+
+namespace Memory {
+
+enum AccessType
+{
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_FETCH,
+    ACCESS_TYPES
+};
+
+// Counts bus accesses per 16 byte granule of the address
+// space, and per switchable ROM/RAM bank.
+// Dumped to a file that tools/heatmap.py turns into an image
+class AccessProfile
+{
+public:
+    static const int GRANULE_SIZE = 16;
+    static const int GRANULES = 0x10000 / GRANULE_SIZE;
+    static const int ROM_BANKS = 512;
+    static const int RAM_BANKS = 16;
+
+    void Count(AccessType type, u16 address, int romBank, int ramBank);
+    // File layout (little endian):
+    //     char[4] "JXHM", u32 version,
+    //     u32 GRANULES, u32 ROM_BANKS, u32 RAM_BANKS,
+    //     u64 granules[ACCESS_TYPES][GRANULES],
+    //     u64 romBanks[ACCESS_TYPES][ROM_BANKS],
+    //     u64 ramBanks[ACCESS_TYPES][RAM_BANKS]
+    bool Save(const std::string& path);
+
+private:
+    u64 granules[ACCESS_TYPES][GRANULES] = {};
+    u64 romBanks[ACCESS_TYPES][ROM_BANKS] = {};
+    u64 ramBanks[ACCESS_TYPES][RAM_BANKS] = {};
+};
+
+}; // namespace Memory
@@ -0,0 +1,103 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Cheats.h"
+
+#include <cctype>
+#include <stdexcept>
+
+
+namespace Memory {
+
+// Returns the value of each hex digit, dropping
+// dashes, or an empty vector if there's anything else
+static std::vector<u8> ParseDigits(const std::string& code)
+{
+    std::vector<u8> digits;
+    for(char c : code)
+    {
+        if(c == '-')
+            continue;
+        if(!std::isxdigit(static_cast<unsigned char>(c)))
+            return std::vector<u8>();
+        digits.push_back(std::isdigit(static_cast<unsigned char>(c))?
+            c - '0' : std::toupper(static_cast<unsigned char>(c)) - 'A' + 10);
+    }
+    return digits;
+}
+
+void Cheats::Add(const std::string& code)
+{
+    std::vector<u8> digits = ParseDigits(code);
+    // GameShark codes are never written with dashes
+    if(digits.size() == 8 && code.find('-') == std::string::npos)
+    {
+        // BBVVLLHH: bank, value, then the address low byte first
+        RamFreeze freeze;
+        freeze.bank = (digits[0] << 4) | digits[1];
+        freeze.value = (digits[2] << 4) | digits[3];
+        freeze.address = (digits[6] << 12) | (digits[7] << 8) | (digits[4] << 4) | digits[5];
+        // ROM and VRAM writes would hit the MBC or skip the PPU,
+        // and OAM and IO writes have side effects every frame
+        if(freeze.address < 0xA000)
+            throw std::invalid_argument("GameShark code " + code + " is for ROM or VRAM");
+        if(freeze.address >= 0xFE00 && (freeze.address < 0xFF80 || freeze.address == 0xFFFF))
+            throw std::invalid_argument("GameShark code " + code + " is for OAM or IO");
+        // Echo RAM is WRAM
+        if(freeze.address >= 0xE000 && freeze.address < 0xFE00)
+            freeze.address -= 0x2000;
+        freezes.push_back(freeze);
+        return;
+    }
+    if(digits.size() == 6 || digits.size() == 9)
+    {
+        // ABC-DEF-GHI: AB is the value, FCDE the address with F
+        // inverted, and G and I the scrambled compare byte
+        RomPatch patch;
+        patch.value = (digits[0] << 4) | digits[1];
+        patch.address = ((digits[5] ^ 0xF) << 12) | (digits[2] << 8) | (digits[3] << 4) | digits[4];
+        patch.compare = digits.size() == 9;
+        patch.compareValue = 0;
+        if(patch.compare)
+        {
+            u8 value = (digits[6] << 4) | digits[8];
+            value = (value >> 2) | (value << 6);
+            patch.compareValue = value ^ 0xBA;
+        }
+        if(patch.address >= 0x8000)
+            throw std::invalid_argument("Game Genie code " + code + " isn't for ROM");
+        patches.push_back(patch);
+        return;
+    }
+    throw std::invalid_argument("Invalid cheat code " + code);
+}
+
+void Cheats::Clear()
+{
+    patches.clear();
+    freezes.clear();
+}
+
+u8 Cheats::Patch(u16 address, u8 data)
+{
+    for(const RomPatch& patch : patches)
+    {
+        if(patch.address == address && (!patch.compare || patch.compareValue == data))
+            return patch.value;
+    }
+    return data;
+}
+
+}; // namespace Memory
@@ -0,0 +1,66 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+#include "../../common/Types.h"
+
+#include <string>
+#include <vector>
+
+
+namespace Memory {
+
+// Cheat codes, parsed and kept here for the MemoryBus to apply.
+// Game Genie codes patch ROM reads, GameShark codes freeze RAM
+class Cheats
+{
+public:
+    struct RomPatch
+    {
+        u16 address;
+        u8 value;
+        // 9 digit codes only patch while the ROM
+        // has compareValue there (i.e. in one bank)
+        bool compare;
+        u8 compareValue;
+    };
+    struct RamFreeze
+    {
+        // unused on the DMG's unbanked RAM
+        u8 bank;
+        u16 address;
+        u8 value;
+    };
+
+    // Takes Game Genie (ABC-DEF or ABC-DEF-GHI) or GameShark
+    // (ABCDEFGH) codes. throws std::invalid_argument if it isn't
+    // either, or if it's for memory it can't change
+    void Add(const std::string& code);
+    void Clear();
+
+    // Applies any patches at address to the byte read from ROM
+    u8 Patch(u16 address, u8 data);
+
+    const std::vector<RomPatch>& GetPatches()
+        { return patches; }
+    const std::vector<RamFreeze>& GetFreezes()
+        { return freezes; }
+
+private:
+    std::vector<RomPatch> patches;
+    std::vector<RamFreeze> freezes;
+};
+
+}; // namespace Memory
@@ -16,7 +16,9 @@
 
 #include "mbc/MBC.h"
 #include "mbc/MBC1.h"
+#include "mbc/MBC2.h"
 #include "mbc/MBC3.h"
+#include "mbc/MBC5.h"
 
 #include "../GameBoy.h"
 #include "../PPU.h"
@@ -26,6 +28,7 @@
 #include "../../common/Globals.h"
 
 #include <string>
+#include <cstring>
 #include <stdexcept>
 
 
@@ -37,16 +40,6 @@ static bool CheckBounds8(u16 address)
 
     return true;
 }
-static bool CheckBounds16(u16 address)
-{
-    if((address >= 0xE000 && address <= 0xFDFF) ||
-       (address+1 >= 0xE000 && address+1 <= 0xFDFF) ||
-       (address >= 0xFEA0 && address <= 0xFEFF) ||
-       (address+1 >= 0xFEA0 && address+1 <= 0xFEFF))
-        return false;
-
-    return true;
-}
 
 
 namespace Memory {
@@ -68,15 +61,18 @@ bool MemoryBus::TryIOWrite(u16 address, u8 data)
             break;
         case 0x40:
             gameboy->ppu->LCDC = data;
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x41:
             gameboy->ppu->STAT = data;
             break;
         case 0x42:
             gameboy->ppu->SCY = data;
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x43:
             gameboy->ppu->SCX = data;
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x44:
             // Writing to this resets it
@@ -89,32 +85,28 @@ bool MemoryBus::TryIOWrite(u16 address, u8 data)
             gameboy->processor->StartDMATransfer(data);
             break;
         case 0x47:
-            gameboy->ppu->BGPalette[0] = gColors[(data & 0b00000011) >> 0];
-            gameboy->ppu->BGPalette[1] = gColors[(data & 0b00001100) >> 2];
-            gameboy->ppu->BGPalette[2] = gColors[(data & 0b00110000) >> 4];
-            gameboy->ppu->BGPalette[3] = gColors[(data & 0b11000000) >> 6];
+            gameboy->ppu->SetPalette(0, data);
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x48:
-            gameboy->ppu->OBJ0Palette[0] = gColors[(data & 0b00000011) >> 0];
-            gameboy->ppu->OBJ0Palette[1] = gColors[(data & 0b00001100) >> 2];
-            gameboy->ppu->OBJ0Palette[2] = gColors[(data & 0b00110000) >> 4];
-            gameboy->ppu->OBJ0Palette[3] = gColors[(data & 0b11000000) >> 6];
+            gameboy->ppu->SetPalette(1, data);
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x49:
-            gameboy->ppu->OBJ1Palette[0] = gColors[(data & 0b00000011) >> 0];
-            gameboy->ppu->OBJ1Palette[1] = gColors[(data & 0b00001100) >> 2];
-            gameboy->ppu->OBJ1Palette[2] = gColors[(data & 0b00110000) >> 4];
-            gameboy->ppu->OBJ1Palette[3] = gColors[(data & 0b11000000) >> 6];
+            gameboy->ppu->SetPalette(2, data);
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x4A:
             gameboy->ppu->WY = data;
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x4B:
             gameboy->ppu->WX = data;
+            gameboy->ppu->RegisterWritten();
             break;
         case 0x50:
             // replace ROM interrupt vectors
-            gameboy->memory_bus->WriteBytes(gameboy->game_rom->GetBytes().data(), 0x0000, 0x100);
+            mbc->UnmapBootROM();
             gameboy->InBootROM = false;
             break;
         case 0xFF:
@@ -170,53 +162,135 @@ void MemoryBus::InitMBC(std::unique_ptr<Core::Rom>& rom)
     switch(rom->GetCartType())
     {
     case 0x00: // Cart Only
+    case 0x08: // ROM + RAM
+    case 0x09: // ROM + RAM + BATTERY
         mbc = std::unique_ptr<MBC> (new MBC(gameboy)); break;
     case 0x01: // MBC1
+    case 0x02: // MBC1 + RAM
+    case 0x03: // MBC1 + RAM + BATTERY
         mbc = std::unique_ptr<MBC> (new MBC1(gameboy)); break;
+    case 0x05: // MBC2
+    case 0x06: // MBC2 + BATTERY
+        mbc = std::unique_ptr<MBC> (new MBC2(gameboy)); break;
+    case 0x0F: // MBC3 + TIMER + BATTERY
+    case 0x10: // MBC3 + TIMER + RAM + BATTERY
+    case 0x11: // MBC3
+    case 0x12: // MBC3 + RAM
     case 0x13: // MBC3 + RAM + BATTERY
         mbc = std::unique_ptr<MBC> (new MBC3(gameboy)); break;
+    case 0x19: // MBC5
+    case 0x1A: // MBC5 + RAM
+    case 0x1B: // MBC5 + RAM + BATTERY
+    case 0x1C: // MBC5 + RUMBLE
+    case 0x1D: // MBC5 + RUMBLE + RAM
+    case 0x1E: // MBC5 + RUMBLE + RAM + BATTERY
+        mbc = std::unique_ptr<MBC> (new MBC5(gameboy)); break;
     default:
         throw std::runtime_error("MBC type unknown! " + std::to_string(rom->GetCartType()));
     }
 
     mbc->Load(rom);
+    mbc->MapMemory();
+    // The PPU draws lines late, so it has to
+    // see VRAM writes before they happen
+    for(int page = 0x80; page < 0xA0; page++)
+        mbc->SetWriteTrap(page, TRAP_VRAM, true);
 }
 
 void MemoryBus::Write8(u16 address, u8 data)
 {
+    u8* page = mbc->GetWritePage(address >> 8);
+    if(page)
+    {
+        page[address & 0xFF] = data;
+        return;
+    }
+
+    WriteSlow(address, data);
+}
+
+void MemoryBus::WriteSlow(u16 address, u8 data)
+{
+    if(profile)
+        profile->Count(ACCESS_WRITE, address, mbc->GetRomBank(), mbc->GetRamBank());
+    if(mbc->GetWriteTraps(address >> 8) & TRAP_WATCH)
+        CheckWatchpoints(address, data, WATCH_WRITE);
+
+    u8* page = mbc->GetHostWritePage(address >> 8);
+    if(page)
+    {
+        bool vram = mbc->GetWriteTraps(address >> 8) & TRAP_VRAM;
+        // lines that haven't been drawn yet need the old contents
+        if(vram)
+            gameboy->ppu->FlushLines();
+        page[address & 0xFF] = data;
+        if(vram)
+            gameboy->ppu->WriteVRAM(address, data);
+        return;
+    }
     if(!CheckBounds8(address))
         return;
     if(TryIOWrite(address, data))
         return;
 
     mbc->Write8(address, data);
+    if(address >= 0xFE00 && address <= 0xFE9F)
+        gameboy->ppu->MarkOAMDirty();
 }
 
 void MemoryBus::Write16(u16 address, u16 data)
 {
-    if(!CheckBounds16(address))
-        return;
-
-    mbc->Write16(address, data);
+    Write8(address, data & 0x00FF);
+    Write8(address + 1, (data & 0xFF00) >> 8);
 }
 
 u8 MemoryBus::Read8(u16 address)
 {
-    if(!CheckBounds8(address))
+    const u8* page = mbc->GetReadPage(address >> 8);
+    if(page)
+        return page[address & 0xFF];
+
+    return ReadSlow(address, ACCESS_READ);
+}
+
+u8 MemoryBus::Fetch8(u16 address)
+{
+    const u8* page = mbc->GetReadPage(address >> 8);
+    if(page)
+        return page[address & 0xFF];
+
+    return ReadSlow(address, ACCESS_FETCH);
+}
+
+u8 MemoryBus::ReadSlow(u16 address, AccessType type)
+{
+    if(profile)
+        profile->Count(type, address, mbc->GetRomBank(), mbc->GetRamBank());
+    // During DMA only IO and HRAM are still on the bus
+    if(dmaLocked && address < 0xFF00)
         return 0xFF;
+
     u8 data;
-    if(TryIORead(address, data))
-        return data;
+    const u8* page = mbc->GetHostReadPage(address >> 8);
+    if(page)
+        data = page[address & 0xFF];
+    else if(!CheckBounds8(address))
+        data = 0xFF;
+    else if(!TryIORead(address, data))
+        data = mbc->Read8(address);
+
+    if(mbc->GetReadTraps(address >> 8) & TRAP_CHEAT)
+        data = cheats->Patch(address, data);
 
-    return mbc->Read8(address);
+    if(mbc->GetReadTraps(address >> 8) & TRAP_WATCH)
+        CheckWatchpoints(address, data, WATCH_READ);
+
+    return data;
 }
 
 u16 MemoryBus::Read16(u16 address)
 {
-    if(!CheckBounds16(address))
-        return 0xFFFF;
-
-    return mbc->Read16(address);
+    return Read8(address) | (Read8(address + 1) << 8);
 }
 // Use raw buffers for these rather than vectors
 // because man is std::vector slow...
@@ -230,4 +304,158 @@ void MemoryBus::ReadBytes(u8* destination, u16 src, u16 size)
     mbc->ReadBytes(destination, src, size);
 }
 
+void MemoryBus::MapBootROM(const u8* bootrom)
+{
+    mbc->MapBootROM(bootrom);
+}
+
+void MemoryBus::TransferOAM(u8 addrH)
+{
+    const int totalBytes = 40*4;
+    u8* oam = mbc->GetOAM();
+    const u8* src = mbc->GetReadPage(addrH);
+    if(src)
+    {
+        // Plain memory, so copy the whole page at once
+        std::memcpy(oam, src, totalBytes);
+    }
+    else
+    {
+        u16 address = addrH << 8;
+        for(int i = 0; i < totalBytes; i++)
+            oam[i] = Read8(address+i);
+    }
+    gameboy->ppu->MarkOAMDirty();
+}
+
+int MemoryBus::AddWatchpoint(u16 start, u16 end, u8 type)
+{
+    watchpoints.push_back({start, end, type, true});
+    UpdateWatchTraps();
+    return watchpoints.size() - 1;
+}
+
+void MemoryBus::RemoveWatchpoint(int id)
+{
+    // ids stay stable, so just blank it out
+    watchpoints.at(id).type = 0;
+    UpdateWatchTraps();
+}
+
+void MemoryBus::EnableWatchpoint(int id, bool enabled)
+{
+    watchpoints.at(id).enabled = enabled;
+    UpdateWatchTraps();
+}
+
+void MemoryBus::UpdateWatchTraps()
+{
+    for(int page = 0x00; page <= 0xFF; page++)
+    {
+        mbc->SetReadTrap(page, TRAP_WATCH, false);
+        mbc->SetWriteTrap(page, TRAP_WATCH, false);
+    }
+    for(const Watchpoint& watch : watchpoints)
+    {
+        if(!watch.enabled)
+            continue;
+        for(int page = watch.start >> 8; page <= (watch.end >> 8); page++)
+        {
+            if(watch.type & WATCH_READ)
+                mbc->SetReadTrap(page, TRAP_WATCH, true);
+            if(watch.type & WATCH_WRITE)
+                mbc->SetWriteTrap(page, TRAP_WATCH, true);
+        }
+    }
+}
+
+void MemoryBus::CheckWatchpoints(u16 address, u8 value, WatchType type)
+{
+    // Only reached for accesses to trapped pages,
+    // so a linear search is fine here
+    for(const Watchpoint& watch : watchpoints)
+    {
+        if(!watch.enabled || !(watch.type & type) ||
+           address < watch.start || address > watch.end)
+            continue;
+
+        if(watchCallback)
+        {
+            WatchHit hit;
+            hit.pc = gameboy->processor->instructionPC;
+            hit.address = address;
+            hit.value = value;
+            hit.type = type;
+            hit.cycle = gameboy->GetCycles();
+            watchCallback(hit);
+        }
+        return;
+    }
+}
+
+void MemoryBus::EnableProfile(bool enabled)
+{
+    if(enabled && !profile)
+        profile = std::unique_ptr<AccessProfile> (new AccessProfile());
+    else if(!enabled)
+        profile.reset();
+
+    for(int page = 0x00; page <= 0xFF; page++)
+    {
+        mbc->SetReadTrap(page, TRAP_PROFILE, enabled);
+        mbc->SetWriteTrap(page, TRAP_PROFILE, enabled);
+    }
+}
+
+bool MemoryBus::SaveProfile(const std::string& path)
+{
+    if(!profile)
+        return false;
+    return profile->Save(path);
+}
+
+void MemoryBus::AddCheat(const std::string& code)
+{
+    if(!cheats)
+        cheats = std::unique_ptr<Cheats> (new Cheats());
+    cheats->Add(code);
+
+    for(auto& patch : cheats->GetPatches())
+        mbc->SetReadTrap(patch.address >> 8, TRAP_CHEAT, true);
+}
+
+void MemoryBus::ClearCheats()
+{
+    if(!cheats)
+        return;
+    for(auto& patch : cheats->GetPatches())
+        mbc->SetReadTrap(patch.address >> 8, TRAP_CHEAT, false);
+    cheats.reset();
+}
+
+void MemoryBus::ApplyCheatFreezes()
+{
+    for(auto& freeze : cheats->GetFreezes())
+    {
+        // Straight to memory, so these don't trip
+        // watchpoints or count as CPU writes
+        u8* page = mbc->GetHostWritePage(freeze.address >> 8);
+        if(page)
+            page[freeze.address & 0xFF] = freeze.value;
+        else if(freeze.address < 0xC000 || freeze.address >= 0xFF80)
+            // Cart RAM the MBC handles itself (or that's
+            // disabled), and HRAM
+            mbc->Write8(freeze.address, freeze.value);
+    }
+}
+
+void MemoryBus::LockDMA(bool locked)
+{
+    // Trapping every page below IO keeps the
+    // lockout check off the fast path
+    dmaLocked = locked;
+    for(int page = 0x00; page < 0xFF; page++)
+        mbc->SetReadTrap(page, TRAP_DMA, locked);
+}
+
 }; // namespace Memory
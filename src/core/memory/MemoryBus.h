@@ -13,11 +13,16 @@
 // limitations under the License.
 
 #pragma once
+#include "AccessProfile.h"
+#include "Cheats.h"
 #include "mbc/MBC.h"
 
 #include "../../common/Types.h"
 
 #include <memory>
+#include <string>
+#include <vector>
+#include <functional>
 
 
 namespace Core {
@@ -27,13 +32,57 @@ namespace Core {
 
 namespace Memory {
 
+enum WatchType : u8
+{
+    WATCH_READ = 0x01,
+    WATCH_WRITE = 0x02
+};
+
+struct WatchHit
+{
+    // PC of the instruction doing the access
+    u16 pc;
+    u16 address;
+    u8 value;
+    WatchType type;
+    // system cycles when the instruction started
+    u64 cycle;
+};
+using WatchCallback = std::function<void(const WatchHit&)>;
+
 class MemoryBus
 {
     Core::GameBoy* gameboy;
     std::unique_ptr<MBC> mbc;
 
+    // Set while an OAM DMA transfer holds the bus
+    bool dmaLocked = false;
+
+    struct Watchpoint
+    {
+        u16 start;
+        u16 end;
+        // WatchType flags, 0 once removed
+        u8 type;
+        bool enabled;
+    };
+    std::vector<Watchpoint> watchpoints;
+    WatchCallback watchCallback;
+    // Traps the pages of every enabled watchpoint
+    void UpdateWatchTraps();
+    void CheckWatchpoints(u16 address, u8 value, WatchType type);
+
     bool TryIOWrite(u16 address, u8 data);
     bool TryIORead(u16 address, u8& retval);
+    // Accesses to pages that aren't mapped in the memory map
+    void WriteSlow(u16 address, u8 data);
+    u8 ReadSlow(u16 address, AccessType type);
+
+    // Only allocated while profiling
+    std::unique_ptr<AccessProfile> profile;
+    // Only allocated once a cheat is added
+    std::unique_ptr<Cheats> cheats;
+    void ApplyCheatFreezes();
 
 public:
     MemoryBus(Core::GameBoy* gameboy)
@@ -45,9 +94,46 @@ public:
     void Write16(u16 address, u16 data);
     u8 Read8(u16 address);
     u16 Read16(u16 address);
+    // Same as Read8, but counted as an instruction fetch
+    u8 Fetch8(u16 address);
 
     void WriteBytes(const u8* src, u16 destination, u16 size);
     void ReadBytes(u8* destination, u16 src, u16 size);
+
+    // Overlays the 256 byte boot ROM at 0x0000
+    // until it's unmapped by writing to 0xFF50
+    void MapBootROM(const u8* bootrom);
+
+    // Copies 0xXX00-0xXX9F to OAM
+    void TransferOAM(u8 addrH);
+    // While locked, the CPU can only see IO and HRAM
+    void LockDMA(bool locked);
+
+    // Watchpoints only slow down the pages they cover;
+    // returns an id for enabling/removing it later
+    int AddWatchpoint(u16 start, u16 end, u8 type);
+    void RemoveWatchpoint(int id);
+    void EnableWatchpoint(int id, bool enabled);
+    void SetWatchCallback(WatchCallback callback)
+        { watchCallback = callback; }
+
+    // Traps every page and counts accesses into an AccessProfile
+    void EnableProfile(bool enabled);
+    bool SaveProfile(const std::string& path);
+
+    // Game Genie codes trap just the ROM pages they patch,
+    // GameShark codes are written once a frame at V-Blank.
+    // throws std::invalid_argument if the code can't be used
+    void AddCheat(const std::string& code);
+    void ClearCheats();
+    // Called by the PPU on entering V-Blank
+    void VBlank()
+        { if(cheats) ApplyCheatFreezes(); }
+
+    u8* GetVRAM()
+        { return mbc->GetVRAM(); }
+    u8* GetOAM()
+        { return mbc->GetOAM(); }
 };
 
 }; // namespace Memory
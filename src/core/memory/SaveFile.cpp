@@ -0,0 +1,154 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "SaveFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace Memory {
+
+// How often dirty pages are flushed to disk
+static const int FLUSH_INTERVAL_MS = 1000;
+
+// The one thread that flushes every open save. It's
+// started by the first save and runs until exit
+class SaveFlusher
+{
+    // Held while flushing, so a save can't be
+    // unmapped in the middle of its msync
+    std::mutex mutex;
+    std::condition_variable signal;
+    std::vector<SaveFile*> saves;
+    std::thread thread;
+    bool stopping = false;
+
+    void FlushLoop()
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        while(!stopping)
+        {
+            signal.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+            if(stopping)
+                break;
+            for(SaveFile* save : saves)
+                save->Flush();
+        }
+    }
+
+public:
+    ~SaveFlusher()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            stopping = true;
+        }
+        signal.notify_one();
+        if(thread.joinable())
+            thread.join();
+    }
+
+    void Add(SaveFile* save)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        saves.push_back(save);
+        if(!thread.joinable())
+            thread = std::thread(&SaveFlusher::FlushLoop, this);
+    }
+
+    void Remove(SaveFile* save)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        saves.erase(std::remove(saves.begin(), saves.end(), save), saves.end());
+    }
+};
+
+static SaveFlusher& GetFlusher()
+{
+    static SaveFlusher flusher;
+    return flusher;
+}
+
+SaveFile::SaveFile(const std::string& path, u32 size)
+:   fd(-1),
+    size(size),
+    bytes(nullptr)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        throw std::runtime_error("Error opening save file " + path);
+
+    // Released when fd is closed. Only a lock that's
+    // already held means another instance has it open,
+    // anything else (e.g. no lock support) is an error
+    if(flock(fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        bool held = (errno == EWOULDBLOCK);
+        close(fd);
+        if(held)
+            throw InUse(path);
+        throw std::runtime_error("Error locking save file " + path);
+    }
+
+    // A new (or short) save is zero filled up to size,
+    // anything already in it is kept
+    struct stat info;
+    if(fstat(fd, &info) < 0 ||
+       (static_cast<u32>(info.st_size) < size && ftruncate(fd, size) < 0))
+    {
+        close(fd);
+        throw std::runtime_error("Error resizing save file " + path);
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("Error mapping save file " + path);
+    }
+    bytes = static_cast<u8*>(mapping);
+
+    GetFlusher().Add(this);
+}
+
+SaveFile::~SaveFile()
+{
+    GetFlusher().Remove(this);
+
+    Flush();
+    munmap(bytes, size);
+    close(fd);
+}
+
+void SaveFile::Flush()
+{
+    // The kernel tracks which pages are dirty,
+    // so this only writes what changed
+    msync(bytes, size, MS_SYNC);
+}
+
+}; // namespace Memory
@@ -0,0 +1,61 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+#include "../../common/Types.h"
+
+#include <stdexcept>
+#include <string>
+
+
+namespace Memory {
+
+// Cartridge RAM backed by a memory mapped .sav file.
+// The emulator writes straight into the mapping, and
+// one background thread shared by every open save
+// msyncs them so only the dirty pages get written
+// out, without stalling emulation.
+// The file is locked while it's open, so two
+// instances can't share (and corrupt) the same save
+class SaveFile
+{
+    int fd;
+    u32 size;
+    u8* bytes;
+
+public:
+    // Thrown when another instance has the save open
+    struct InUse : public std::runtime_error
+    {
+        InUse(const std::string& path)
+        :   std::runtime_error("Save file " + path + " is in use")
+        {
+        }
+    };
+
+    // throws InUse if the file is locked, std::runtime_error
+    // if it can't be locked or mapped
+    SaveFile(const std::string& path, u32 size);
+    ~SaveFile();
+
+    u8* GetRaw()
+        { return bytes; }
+    u32 GetSize()
+        { return size; }
+
+    void Flush();
+};
+
+}; // namespace Memory
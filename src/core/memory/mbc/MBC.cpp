@@ -16,9 +16,11 @@
 
 #include "../../GameBoy.h"
 #include "../../Rom.h"
+#include "../../../debug/Logger.h"
 
 #include <string>
 #include <cstring>
+#include <algorithm>
 #include <stdexcept>
 
 
@@ -26,30 +28,55 @@ namespace Memory {
 
 MBC::MBC(Core::GameBoy* gameboy)
 :   gameboy(gameboy),
-    romBank0(new MemoryPage(0x0000, 0x4000)),
-    romBank1(new MemoryPage(0x4000, 0x4000)),
+    romBytes(nullptr),
+    numRomBanks(0),
     vram(new MemoryPage(0x8000, 0x2000)),
-    sram(new MemoryPage(0xA000, 0x2000)),
     wram(new MemoryPage(0xC000, 0x2000)),
     oam(new MemoryPage(0xFE00, 0x00A0)),
-    highRam(new MemoryPage(0xFF80, 0x007F))
+    highRam(new MemoryPage(0xFF80, 0x007F)),
+    readMap(),
+    writeMap(),
+    hostRead(),
+    hostWrite(),
+    readTraps(),
+    writeTraps()
 {}
 
+void MBC::LoadROM(std::unique_ptr<Core::Rom>& rom)
+{
+    romImage = rom->GetImage();
+    romBytes = romImage->data();
+    // the registry pads images to at least two whole banks
+    numRomBanks = romImage->size() / 0x4000;
+}
+
+const u8* MBC::GetRomBankBytes(u32 bank)
+{
+    if(bank >= numRomBanks)
+        return nullptr;
+    return romBytes + (bank * 0x4000);
+}
+
 void MBC::Load(std::unique_ptr<Core::Rom>& rom)
 {
-    WriteBytes(rom->GetBytes().data(), 0x0000, 0x4000);
-    WriteBytes(rom->GetBytes().data()+0x4000, 0x4000, 0x4000);
+    LoadROM(rom);
+
+    // ROM + RAM carts get at most one bank
+    u32 ramBytes = std::min<u32>(rom->GetRAMBytes(), 0x2000);
+    if(ramBytes != 0) {
+        u8* save = OpenSaveFile(rom, ramBytes);
+        if(save)
+            sram = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, ramBytes, save));
+        else
+            sram = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, ramBytes));
+    }
 }
 
 std::unique_ptr<MemoryPage>& MBC::GetPage(u16 address)
 {
-    if(address >= 0x0000 && address <= 0x3FFF)
-        return romBank0;
-    if(address >= 0x4000 && address <= 0x7FFF)
-        return romBank1;
     if(address >= 0x8000 && address <= 0x9FFF)
         return vram;
-    if(address >= 0xA000 && address <= 0xBFFF)
+    if(address >= 0xA000 && address <= 0xBFFF && sram)
         return sram;
     if(address >= 0xC000 && address <= 0xDFFF)
         return wram;
@@ -61,13 +88,139 @@ std::unique_ptr<MemoryPage>& MBC::GetPage(u16 address)
     throw std::out_of_range("Address out of bounds!");
 }
 
+u8* MBC::OpenSaveFile(std::unique_ptr<Core::Rom>& rom, u32 size)
+{
+    const std::string& path = gameboy->GetOptions().save_path;
+    if(!rom->HasBattery() || path.empty() || size == 0)
+        return nullptr;
+
+    try
+    {
+        saveFile = std::unique_ptr<SaveFile> (new SaveFile(path, size));
+    }
+    catch(std::runtime_error& e)
+    {
+        // In use by another instance, or somewhere read only.
+        // Still playable, just without saving
+        LOG_WARN(std::string(e.what()) + ", cart RAM won't be saved");
+        return nullptr;
+    }
+    return saveFile->GetRaw();
+}
+
+u8* MBC::GetRaw(u16 address)
+{
+    // Banks that don't exist (or aren't selectable)
+    // are left unmapped so the slow path reports them
+    try
+    {
+        std::unique_ptr<MemoryPage>& page = GetPage(address);
+        return page->GetRaw() + (address - page->GetBase());
+    }
+    catch(std::out_of_range& e)
+    {
+        return nullptr;
+    }
+}
+
+void MBC::MapRegion(u16 base, u32 size, u8* bytes, bool writable)
+{
+    for(u32 offset = 0; offset < size; offset += 0x100)
+    {
+        u8 page = (base + offset) >> 8;
+        hostRead[page] = (bytes)? bytes + offset : nullptr;
+        hostWrite[page] = (bytes && writable)? bytes + offset : nullptr;
+        ApplyTraps(page);
+    }
+}
+
+void MBC::MapRegion(u16 base, u32 size, const u8* bytes)
+{
+    // read only
+    for(u32 offset = 0; offset < size; offset += 0x100)
+    {
+        u8 page = (base + offset) >> 8;
+        hostRead[page] = (bytes)? bytes + offset : nullptr;
+        hostWrite[page] = nullptr;
+        ApplyTraps(page);
+    }
+}
+
+void MBC::ApplyTraps(u8 page)
+{
+    readMap[page] = (readTraps[page] == 0)? hostRead[page] : nullptr;
+    writeMap[page] = (writeTraps[page] == 0)? hostWrite[page] : nullptr;
+}
+
+void MBC::MapMemory()
+{
+    // Writes to ROM go to the MBC registers, and
+    // echo RAM, OAM, IO and HRAM always take the slow path
+    MapRegion(0x0000, 0x4000, GetRomBankBytes(0));
+    if(bootRom)
+        MapRegion(0x0000, 0x0100, bootRom->GetRaw(), false);
+    MapRegion(0x8000, 0x2000, GetRaw(0x8000), true);
+    MapRegion(0xC000, 0x2000, GetRaw(0xC000), true);
+    MapBanks();
+}
+
+void MBC::MapBanks()
+{
+    // Banks past the end of the ROM stay unmapped
+    MapRegion(0x4000, 0x4000, GetRomBankBytes(GetRomBank()));
+    // Cart RAM smaller than 8KB (or none at all) leaves
+    // the rest unmapped, so it reads as open bus
+    MapRegion(0xA000, 0x2000, nullptr, false);
+    u8* ram = GetRaw(0xA000);
+    if(ram)
+        MapRegion(0xA000, std::min<u32>(GetPage(0xA000)->GetSize(), 0x2000), ram, true);
+}
+
+void MBC::MapBootROM(const u8* bytes)
+{
+    // Kept apart from the shared ROM image
+    bootRom = std::unique_ptr<MemoryPage>(new MemoryPage(0x0000, 0x0100));
+    std::memcpy(bootRom->GetRaw(), bytes, 0x0100);
+    MapRegion(0x0000, 0x0100, bootRom->GetRaw(), false);
+}
+
+void MBC::UnmapBootROM()
+{
+    MapRegion(0x0000, 0x0100, GetRomBankBytes(0));
+    bootRom.reset();
+}
+
+void MBC::SetReadTrap(u8 page, u8 trap, bool enabled)
+{
+    if(enabled)
+        readTraps[page] |= trap;
+    else
+        readTraps[page] &= ~trap;
+    ApplyTraps(page);
+}
+
+void MBC::SetWriteTrap(u8 page, u8 trap, bool enabled)
+{
+    if(enabled)
+        writeTraps[page] |= trap;
+    else
+        writeTraps[page] &= ~trap;
+    ApplyTraps(page);
+}
+
 void MBC::Write8(u16 address, u8 data)
 {
+    // ROM is read only
+    if(address <= 0x7FFF)
+        return;
+    // Writes to missing cart RAM go nowhere
+    if(address >= 0xA000 && address <= 0xBFFF && !hostWrite[address >> 8])
+        return;
     try
     {
         std::unique_ptr<MemoryPage>& page = GetPage(address);
         address -= page->GetBase();
-        page->GetBytes().at(address) = data;
+        page->At(address) = data;
     }
     catch(std::out_of_range& e)
     {
@@ -81,8 +234,8 @@ void MBC::Write16(u16 address, u16 data)
     {
         std::unique_ptr<MemoryPage>& page = GetPage(address);
         address -= page->GetBase();
-        page->GetBytes().at(address) = data & 0x00FF;
-        page->GetBytes().at(address + 1) = (data & 0xFF00) >> 8;
+        page->At(address) = data & 0x00FF;
+        page->At(address + 1) = (data & 0xFF00) >> 8;
     }
     catch(std::out_of_range& e)
     {
@@ -92,11 +245,14 @@ void MBC::Write16(u16 address, u16 data)
 
 u8 MBC::Read8(u16 address)
 {
+    // Missing cart RAM is open bus
+    if(address >= 0xA000 && address <= 0xBFFF && !hostRead[address >> 8])
+        return 0xFF;
     try
     {
         std::unique_ptr<MemoryPage>& page = GetPage(address);
         address -= page->GetBase();
-        return page->GetBytes().at(address);
+        return page->At(address);
     }
     catch(std::out_of_range& e)
     {
@@ -111,7 +267,7 @@ u16 MBC::Read16(u16 address)
     {
         std::unique_ptr<MemoryPage>& page = GetPage(address);
         address -= page->GetBase();
-        return page->GetBytes().at(address) | (page->GetBytes().at(address + 1) << 8);
+        return page->At(address) | (page->At(address + 1) << 8);
     }
     catch(std::out_of_range& e)
     {
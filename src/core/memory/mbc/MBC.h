@@ -15,8 +15,11 @@
 #pragma once
 #include "../../../common/Types.h"
 
+#include "../SaveFile.h"
+
 #include <memory>
 #include <vector>
+#include <stdexcept>
 
 
 namespace Core {
@@ -30,17 +33,43 @@ class MemoryPage
 {
     u16 base;
     u32 size;
+    // empty if the page wraps someone else's memory
     std::vector<u8> bytes;
+    u8* raw;
 public:
     MemoryPage(u16 base, u32 size)
     : base(base),
       size(size),
-      bytes(size) {}
+      bytes(size),
+      raw(bytes.data()) {}
+    // Wraps memory owned elsewhere, i.e. a mapped save file
+    MemoryPage(u16 base, u32 size, u8* external)
+    : base(base),
+      size(size),
+      raw(external) {}
 
     u16 GetBase() { return base; }
     u32 GetSize() { return size; }
-    std::vector<u8>& GetBytes() { return bytes; }
-    u8* GetRaw() { return bytes.data(); }
+    u8* GetRaw() { return raw; }
+    // Bounds checked access
+    u8& At(u32 offset)
+    {
+        if(offset >= size)
+            throw std::out_of_range("Page offset out of range!");
+        return raw[offset];
+    }
+};
+
+// Reasons a page of the memory map can be forced
+// onto the slow path; a page is only fast when
+// none of these are set
+enum PageTrap : u8
+{
+    TRAP_DMA = 0x01,
+    TRAP_WATCH = 0x02,
+    TRAP_PROFILE = 0x04,
+    TRAP_CHEAT = 0x08,
+    TRAP_VRAM = 0x10
 };
 
 class MBC
@@ -48,20 +77,88 @@ class MBC
 protected:
     Core::GameBoy* gameboy;
 
-    std::unique_ptr<MemoryPage> romBank0;
-    std::unique_ptr<MemoryPage> romBank1;
+    // The cart's ROM is mapped straight out of the
+    // image shared by every instance running it
+    std::shared_ptr<const std::vector<u8>> romImage;
+    const u8* romBytes;
+    u32 numRomBanks;
+    // Mapped over 0x0000-0x00FF until the game takes over
+    std::unique_ptr<MemoryPage> bootRom;
     std::unique_ptr<MemoryPage> vram;
+    // only allocated for ROM + RAM carts
     std::unique_ptr<MemoryPage> sram;
     std::unique_ptr<MemoryPage> wram;
     std::unique_ptr<MemoryPage> oam;
     std::unique_ptr<MemoryPage> highRam;
 
+    // Host pointers for every 256 byte page of the address space.
+    // The bus reads and writes straight through these, and
+    // a nullptr page goes through the slow path instead
+    const u8* readMap[0x100];
+    u8* writeMap[0x100];
+    // What each page maps to when it isn't trapped
+    const u8* hostRead[0x100];
+    u8* hostWrite[0x100];
+    u8 readTraps[0x100];
+    u8 writeTraps[0x100];
+
+    // Battery backed RAM, if the cart has any
+    std::unique_ptr<SaveFile> saveFile;
+    // Returns size bytes of memory backed by the save
+    // file, or nullptr if this cart doesn't get one
+    u8* OpenSaveFile(std::unique_ptr<Core::Rom>& rom, u32 size);
+
+    void LoadROM(std::unique_ptr<Core::Rom>& rom);
+    // nullptr if the bank is past the end of the ROM
+    const u8* GetRomBankBytes(u32 bank);
+
+    u8* GetRaw(u16 address);
+    void MapRegion(u16 base, u32 size, u8* bytes, bool writable);
+    void MapRegion(u16 base, u32 size, const u8* bytes);
+    void ApplyTraps(u8 page);
+
 public:
     MBC(Core::GameBoy* gameboy);
+    virtual ~MBC() {}
     virtual void Load(std::unique_ptr<Core::Rom>& rom);
 
     virtual std::unique_ptr<MemoryPage>& GetPage(u16 address);
 
+    // Rebuilds the whole memory map
+    void MapMemory();
+    // Remaps only the switchable regions, called
+    // whenever a bank register changes
+    virtual void MapBanks();
+    void MapBootROM(const u8* bytes);
+    void UnmapBootROM();
+
+    inline const u8* GetReadPage(u8 page)
+        { return readMap[page]; }
+    inline u8* GetWritePage(u8 page)
+        { return writeMap[page]; }
+    void SetReadTrap(u8 page, u8 trap, bool enabled);
+    void SetWriteTrap(u8 page, u8 trap, bool enabled);
+    // The untrapped mapping, for the slow path
+    inline const u8* GetHostReadPage(u8 page)
+        { return hostRead[page]; }
+    inline u8* GetHostWritePage(u8 page)
+        { return hostWrite[page]; }
+    inline u8 GetReadTraps(u8 page)
+        { return readTraps[page]; }
+    inline u8 GetWriteTraps(u8 page)
+        { return writeTraps[page]; }
+
+    // Currently selected switchable banks
+    virtual int GetRomBank()
+        { return 1; }
+    virtual int GetRamBank()
+        { return 0; }
+
+    u8* GetVRAM()
+        { return vram->GetRaw(); }
+    u8* GetOAM()
+        { return oam->GetRaw(); }
+
     virtual void Write8(u16 address, u8 data);
     virtual void Write16(u16 address, u16 data);
     virtual u8 Read8(u16 address);
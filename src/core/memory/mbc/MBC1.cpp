@@ -17,9 +17,8 @@
 #include "../../GameBoy.h"
 #include "../../Rom.h"
 
-#include <cmath>
+#include <algorithm>
 #include <string>
-#include <cstring>
 #include <stdexcept>
 
 
@@ -29,6 +28,7 @@ MBC1::MBC1(Core::GameBoy* gameboy)
 :   MBC(gameboy)
 {
     romBank = 0x01;
+    numRamBanks = 0;
     extRamEnabled = false;
     ramBanking = false;
     selectedBank = 0x00;
@@ -36,41 +36,59 @@ MBC1::MBC1(Core::GameBoy* gameboy)
 
 void MBC1::Load(std::unique_ptr<Core::Rom>& rom)
 {
-    WriteBytes(rom->GetBytes().data(), 0x0000, 0x4000);
-    // initialize all ROM banks
-    u16 romSize = 32 * pow(2, rom->GetROMSize());
-    u8 banks = romSize / 16; 
-
-    numBanks = banks;
-
-    for(int i = 1; i < banks; i++) {
-        switchableBanks.push_back(std::unique_ptr<MemoryPage>(new MemoryPage(0x4000, 0x4000)));
+    // ROM banks are mapped from the shared image, not copied
+    LoadROM(rom);
+    // only allocate the RAM the header says is there
+    u32 ramBytes = std::min<u32>(rom->GetRAMBytes(), 4 * 0x2000);
+    LoadRAM(OpenSaveFile(rom, ramBytes), ramBytes);
+}
 
-        std::memcpy(switchableBanks.at(i-1)->GetRaw(), rom->GetBytes().data() + (0x4000*i), 0x4000);
-    }
-    for(int i = 0; i < 4; i++) {
-        ramBanks[i] = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, 0x2000));
+void MBC1::LoadRAM(u8* save, u32 ramBytes)
+{
+    numRamBanks = 0;
+    for(u32 i = 0; i < ramBytes; i += 0x2000) {
+        u32 size = std::min<u32>(ramBytes - i, 0x2000);
+        if(save)
+            ramBanks[numRamBanks++] = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, size, save + i));
+        else
+            ramBanks[numRamBanks++] = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, size));
     }
 }
 
+std::unique_ptr<MemoryPage>& MBC1::GetRamPage(u8 bank)
+{
+    if(numRamBanks == 0)
+        throw std::out_of_range("No cartridge RAM!");
+    return ramBanks[WrapRamBank(bank)];
+}
+
 std::unique_ptr<MemoryPage>& MBC1::GetPage(u16 address)
 {
-    if(address >= 0x4000 && address <= 0x7FFF) {
-        if(!ramBanking)
-            return switchableBanks.at(romBank - 1 | (selectedBank << 5));
-        else
-            return switchableBanks.at(romBank - 1);
-    }
     if(address >= 0xA000 && address <= 0xBFFF) {
         if(!extRamEnabled || !ramBanking)
-            return ramBanks[0x00];
+            return GetRamPage(0x00);
         else
-            return ramBanks[selectedBank];
+            return GetRamPage(selectedBank);
     }
 
     return MBC::GetPage(address);
 }
 
+int MBC1::GetRomBank()
+{
+    // Bank bits past the end of the ROM are ignored
+    if(!ramBanking)
+        return (((romBank - 1) | (selectedBank << 5)) + 1) % numRomBanks;
+    return romBank % numRomBanks;
+}
+
+int MBC1::GetRamBank()
+{
+    if(!extRamEnabled || !ramBanking)
+        return 0x00;
+    return WrapRamBank(selectedBank);
+}
+
 void MBC1::Write8(u16 address, u8 data)
 {
     if(address >= 0x0000 && address <= 0x1FFF)
@@ -79,6 +97,7 @@ void MBC1::Write8(u16 address, u8 data)
             extRamEnabled = true;
         else
             extRamEnabled = false;
+        MapBanks();
         return;
     }
     if(address >= 0x2000 && address <= 0x3FFF)
@@ -87,11 +106,13 @@ void MBC1::Write8(u16 address, u8 data)
         if((data & 0x0F) == 0x00)
             data++;
         romBank = data & 0x1F;
+        MapBanks();
         return;
     }
     if(address >= 0x4000 && address <= 0x5FFF)
     {
         selectedBank = data;
+        MapBanks();
         return;
     }
     if(address >= 0x6000 && address <= 0x7FFF)
@@ -100,6 +121,7 @@ void MBC1::Write8(u16 address, u8 data)
             ramBanking = false;
         else
             ramBanking = true;
+        MapBanks();
         return;
     }
     MBC::Write8(address, data);
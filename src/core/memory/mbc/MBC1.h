@@ -22,19 +22,30 @@ class MBC1
 : public MBC
 {
 protected:
-    std::vector<std::unique_ptr<MemoryPage>> switchableBanks;
     u8 romBank;
-    u8 numBanks;
     bool extRamEnabled;
     bool ramBanking;
+    // Only the first numRamBanks are allocated
     std::unique_ptr<MemoryPage> ramBanks[0x04];
+    u8 numRamBanks;
     u8 selectedBank;
 
+    // The bank that's actually there, smaller RAM chips
+    // ignore the upper bank bits. 0 if the cart has no RAM
+    int WrapRamBank(u8 bank)
+        { return numRamBanks? bank % numRamBanks : 0; }
+    // throws std::out_of_range if the cart has no RAM
+    std::unique_ptr<MemoryPage>& GetRamPage(u8 bank);
+    // Splits ramBytes into banks, backed by save if there is one
+    void LoadRAM(u8* save, u32 ramBytes);
+
 public:
     MBC1(Core::GameBoy* gameboy);
     virtual void Load(std::unique_ptr<Core::Rom>& rom);
 
     virtual std::unique_ptr<MemoryPage>& GetPage(u16 address);
+    virtual int GetRomBank();
+    virtual int GetRamBank();
 
     virtual void Write8(u16 address, u8 data);
 };
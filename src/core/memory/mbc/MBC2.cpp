@@ -0,0 +1,97 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "MBC2.h"
+
+#include "../../GameBoy.h"
+#include "../../Rom.h"
+
+#include <string>
+#include <stdexcept>
+
+
+namespace Memory {
+
+MBC2::MBC2(Core::GameBoy* gameboy)
+:   MBC(gameboy)
+{
+    romBank = 0x01;
+    extRamEnabled = false;
+}
+
+void MBC2::Load(std::unique_ptr<Core::Rom>& rom)
+{
+    LoadROM(rom);
+
+    u8* save = OpenSaveFile(rom, 0x0200);
+    if(save)
+        nibbleRam = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, 0x0200, save));
+    else
+        nibbleRam = std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, 0x0200));
+}
+
+void MBC2::MapBanks()
+{
+    MBC::MapBanks();
+
+    // The 512 byte RAM repeats across all of A000-BFFF. It's
+    // left on the slow path so Read8 can set the upper nibble
+    MapRegion(0xA000, 0x2000, nullptr, false);
+}
+
+void MBC2::Write8(u16 address, u8 data)
+{
+    if(address >= 0x0000 && address <= 0x3FFF)
+    {
+        // Bit 8 of the address picks the register
+        if(address & 0x0100)
+        {
+            romBank = data & 0x0F;
+            if(romBank == 0x00)
+                romBank = 0x01;
+        }
+        else
+        {
+            extRamEnabled = (data & 0x0F) == 0x0A;
+        }
+        MapBanks();
+        return;
+    }
+    if(address >= 0x4000 && address <= 0x7FFF)
+        return;
+    if(address >= 0xA000 && address <= 0xBFFF)
+    {
+        if(extRamEnabled)
+            nibbleRam->GetRaw()[address & 0x01FF] = data & 0x0F;
+        return;
+    }
+
+    MBC::Write8(address, data);
+}
+
+u8 MBC2::Read8(u16 address)
+{
+    if(address >= 0xA000 && address <= 0xBFFF)
+    {
+        if(!extRamEnabled)
+            return 0xFF;
+        // unused upper nibbles read back as 1s
+        return nibbleRam->GetRaw()[address & 0x01FF] | 0xF0;
+    }
+
+    return MBC::Read8(address);
+}
+
+}; // namespace Memory
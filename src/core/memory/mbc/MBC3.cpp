@@ -15,7 +15,12 @@
 #include "MBC3.h"
 
 #include "../../GameBoy.h"
+#include "../../Rom.h"
 
+#include "../../../common/Globals.h"
+
+#include <algorithm>
+#include <ctime>
 #include <string>
 #include <stdexcept>
 
@@ -23,19 +28,194 @@
 namespace Memory {
 
 MBC3::MBC3(Core::GameBoy* gameboy)
-:   MBC1(gameboy) {
-    // TODO: RTC, Battery
+:   MBC1(gameboy),
+    rtcBaseTicks(0),
+    rtcBaseSeconds(0),
+    rtcHalted(false),
+    rtcCarry(false),
+    rtcLatched(),
+    latchState(0xFF),
+    rtcSave(nullptr),
+    hostStart(std::chrono::steady_clock::now())
+{
+}
+
+MBC3::~MBC3()
+{
+    // before the save file is closed
+    SaveRTC();
+}
+
+void MBC3::Load(std::unique_ptr<Core::Rom>& rom)
+{
+    LoadROM(rom);
+    u32 ramBytes = std::min<u32>(rom->GetRAMBytes(), 4 * 0x2000);
+    if(!rom->HasTimer()) {
+        LoadRAM(OpenSaveFile(rom, ramBytes), ramBytes);
+        return;
+    }
+
+    u8* save = OpenSaveFile(rom, ramBytes + RTC_SAVE_SIZE);
+    LoadRAM(save, ramBytes);
+    if(save) {
+        rtcSave = save + ramBytes;
+        LoadRTC();
+    }
+}
+
+// The save's clock fields are little endian
+static u64 ReadLE(const u8* bytes, int size)
+{
+    u64 value = 0;
+    for(int i = size - 1; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void WriteLE(u8* bytes, int size, u64 value)
+{
+    for(int i = 0; i < size; i++, value >>= 8)
+        bytes[i] = value & 0xFF;
+}
+
+void MBC3::LoadRTC()
+{
+    // A new save (or one without a clock) is zero filled
+    u64 savedAt = ReadLE(rtcSave + 40, 8);
+    if(savedAt == 0)
+        return;
+
+    u8 clock[RTC_COUNT];
+    for(int i = 0; i < RTC_COUNT; i++) {
+        clock[i] = ReadLE(rtcSave + i * 4, 4);
+        rtcLatched[i] = ReadLE(rtcSave + 20 + i * 4, 4);
+    }
+    u64 days = ((clock[RTC_DH] & 0x01) << 8) | clock[RTC_DL];
+    rtcBaseSeconds = (days * 86400) + ((clock[RTC_H] % 24) * 3600) +
+                     ((clock[RTC_M] % 60) * 60) + (clock[RTC_S] % 60);
+    rtcHalted = (clock[RTC_DH] & 0x40) != 0;
+    rtcCarry = (clock[RTC_DH] & 0x80) != 0;
+
+    u64 now = std::time(nullptr);
+    if(!rtcHalted && now > savedAt)
+        rtcBaseSeconds += now - savedAt;
+    rtcBaseTicks = RTCTicks();
+}
+
+void MBC3::SaveRTC()
+{
+    if(!rtcSave)
+        return;
+
+    u8 clock[RTC_COUNT];
+    ReadClock(clock);
+    for(int i = 0; i < RTC_COUNT; i++) {
+        WriteLE(rtcSave + i * 4, 4, clock[i]);
+        WriteLE(rtcSave + 20 + i * 4, 4, rtcLatched[i]);
+    }
+    WriteLE(rtcSave + 40, 8, std::time(nullptr));
+}
+
+u64 MBC3::RTCTicks()
+{
+    if(gameboy->GetOptions().rtc_host_clock) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - hostStart;
+        return static_cast<u64>(elapsed.count() * gClockSpeed);
+    }
+    // Emulated time stays deterministic at any speed
+    return gameboy->GetCycles();
+}
+
+u64 MBC3::RTCSeconds()
+{
+    if(rtcHalted)
+        return rtcBaseSeconds;
+
+    // Fold whole seconds into the base, keeping
+    // the leftover ticks for the next second
+    u64 elapsed = (RTCTicks() - rtcBaseTicks) / gClockSpeed;
+    rtcBaseSeconds += elapsed;
+    rtcBaseTicks += elapsed * gClockSpeed;
+
+    // The day counter is 9 bits, and sets the
+    // carry bit when it overflows
+    const u64 maxSeconds = 512 * 86400;
+    if(rtcBaseSeconds >= maxSeconds) {
+        rtcBaseSeconds %= maxSeconds;
+        rtcCarry = true;
+    }
+    return rtcBaseSeconds;
+}
+
+void MBC3::ReadClock(u8* registers)
+{
+    u64 seconds = RTCSeconds();
+    u16 days = seconds / 86400;
+    registers[RTC_S] = seconds % 60;
+    registers[RTC_M] = (seconds / 60) % 60;
+    registers[RTC_H] = (seconds / 3600) % 24;
+    registers[RTC_DL] = days & 0xFF;
+    registers[RTC_DH] = ((days >> 8) & 0x01) |
+                        ((rtcHalted)? 0x40 : 0x00) |
+                        ((rtcCarry)? 0x80 : 0x00);
+}
+
+void MBC3::LatchRTC()
+{
+    ReadClock(rtcLatched);
+    SaveRTC();
+}
+
+void MBC3::WriteRTC(u8 reg, u8 data)
+{
+    u64 seconds = RTCSeconds();
+    u64 s = seconds % 60;
+    u64 m = (seconds / 60) % 60;
+    u64 h = (seconds / 3600) % 24;
+    u64 d = seconds / 86400;
+
+    switch(reg) {
+    case RTC_S:
+        s = data & 0x3F;
+        // writing the seconds resets the sub-second counter
+        rtcBaseTicks = RTCTicks();
+        break;
+    case RTC_M:
+        m = data & 0x3F; break;
+    case RTC_H:
+        h = data & 0x1F; break;
+    case RTC_DL:
+        d = (d & 0x100) | data; break;
+    case RTC_DH:
+        d = (d & 0x0FF) | ((data & 0x01) << 8);
+        rtcCarry = (data & 0x80) != 0;
+        if(rtcHalted && !(data & 0x40))
+            rtcBaseTicks = RTCTicks(); // start counting from now
+        rtcHalted = (data & 0x40) != 0;
+        break;
+    }
+    rtcBaseSeconds = (d * 86400) + (h * 3600) + (m * 60) + s;
+    rtcLatched[reg] = data;
+    SaveRTC();
 }
 
 std::unique_ptr<MemoryPage>& MBC3::GetPage(u16 address)
 {
-    if(address >= 0x4000 && address <= 0x7FFF) {
-        return switchableBanks.at(romBank - 1);
+    if(address >= 0xA000 && address <= 0xBFFF) {
+        return GetRamPage(selectedBank & 0x03);
     }
 
     return MBC1::GetPage(address);
 }
 
+void MBC3::MapBanks()
+{
+    MBC::MapBanks();
+    // RTC registers aren't memory, leave them to Read8
+    if(selectedBank & 0x08)
+        MapRegion(0xA000, 0x2000, nullptr, false);
+}
+
 void MBC3::Write8(u16 address, u8 data)
 {
     if(address >= 0x2000 && address <= 0x3FFF) {
@@ -43,6 +223,19 @@ void MBC3::Write8(u16 address, u8 data)
         if((data & 0x7F) == 0x00)
             data++;
         romBank = data & 0x7F;
+        MapBanks();
+        return;
+    }
+    if(address >= 0x6000 && address <= 0x7FFF) {
+        // Writing 00 then 01 latches the clock
+        if(latchState == 0x00 && data == 0x01)
+            LatchRTC();
+        latchState = data;
+        return;
+    }
+    if(address >= 0xA000 && address <= 0xBFFF && (selectedBank & 0x08)) {
+        if(selectedBank < 0x08 + RTC_COUNT)
+            WriteRTC(selectedBank - 0x08, data);
         return;
     }
 
@@ -51,18 +244,10 @@ void MBC3::Write8(u16 address, u8 data)
 
 u8 MBC3::Read8(u16 address)
 {
-    if(address >= 0xA000 && address <= 0xBFFF) {
-        if(selectedBank & 0x08) {
-            return 0xFF;
-        } else {
-            try {
-                return ramBanks[selectedBank]->GetBytes().at(address - 0xA000);
-            }
-            catch(std::out_of_range& e) {
-                gameboy->SystemError("Memory read out of range!");
-                return 0xFF;
-            }
-        }
+    if(address >= 0xA000 && address <= 0xBFFF && (selectedBank & 0x08)) {
+        if(selectedBank < 0x08 + RTC_COUNT)
+            return rtcLatched[selectedBank - 0x08];
+        return 0xFF;
     }
 
     return MBC1::Read8(address);
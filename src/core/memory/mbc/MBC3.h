@@ -15,17 +15,69 @@
 #pragma once
 #include "MBC1.h"
 
+#include <chrono>
+
 
 namespace Memory {
 
 class MBC3
 : public MBC1
 {
+    // RTC registers, selected as RAM banks 08-0C
+    enum
+    {
+        RTC_S,
+        RTC_M,
+        RTC_H,
+        RTC_DL,
+        RTC_DH,
+        RTC_COUNT
+    };
+    // The clock isn't ticked, it's worked out from how many
+    // clock ticks have passed since rtcBaseTicks whenever
+    // it's latched or written to
+    u64 rtcBaseTicks;
+    u64 rtcBaseSeconds;
+    bool rtcHalted;
+    bool rtcCarry;
+    u8 rtcLatched[RTC_COUNT];
+    u8 latchState;
+    // The clock's part of the save file, after the RAM. It's
+    // the usual 48 byte layout: the clock then the latched
+    // registers as 32 bit values, then a 64 bit UNIX time.
+    // nullptr if the cart has no save
+    u8* rtcSave;
+    // Only used with the host clock option
+    std::chrono::steady_clock::time_point hostStart;
+
+    // Clock ticks (at CPU speed) since power on
+    u64 RTCTicks();
+    // Total seconds on the clock right now
+    u64 RTCSeconds();
+    // The clock as its RTC_COUNT registers
+    void ReadClock(u8* registers);
+    void LatchRTC();
+    void WriteRTC(u8 reg, u8 data);
+    // The clock keeps running while the emulator isn't,
+    // so LoadRTC adds on the time since it was saved
+    void LoadRTC();
+    void SaveRTC();
+
 public:
+    static const u32 RTC_SAVE_SIZE = 48;
+
     MBC3(Core::GameBoy* gameboy);
+    virtual ~MBC3();
+    virtual void Load(std::unique_ptr<Core::Rom>& rom);
 
 
     virtual std::unique_ptr<MemoryPage>& GetPage(u16 address);
+    virtual void MapBanks();
+    virtual int GetRomBank()
+        { return romBank % numRomBanks; }
+    virtual int GetRamBank()
+        { return WrapRamBank(selectedBank & 0x03); }
+
     virtual void Write8(u16 address, u8 data);
     virtual u8 Read8(u16 address);
 };
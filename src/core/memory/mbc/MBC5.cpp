@@ -0,0 +1,96 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "MBC5.h"
+
+#include "../../GameBoy.h"
+#include "../../Rom.h"
+
+#include <string>
+#include <stdexcept>
+
+
+namespace Memory {
+
+MBC5::MBC5(Core::GameBoy* gameboy)
+:   MBC(gameboy)
+{
+    romBank = 0x01;
+    ramBank = 0x00;
+    extRamEnabled = false;
+    hasRumble = false;
+}
+
+void MBC5::Load(std::unique_ptr<Core::Rom>& rom)
+{
+    LoadROM(rom);
+
+    u8 cartType = rom->GetCartType();
+    hasRumble = (cartType >= 0x1C && cartType <= 0x1E);
+
+    u32 ramBytes = rom->GetRAMBytes();
+    u8* save = OpenSaveFile(rom, ramBytes);
+    for(u32 i = 0; i < ramBytes; i += 0x2000) {
+        u32 size = (ramBytes - i < 0x2000)? ramBytes - i : 0x2000;
+        if(save)
+            ramBanks.push_back(std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, size, save + i)));
+        else
+            ramBanks.push_back(std::unique_ptr<MemoryPage>(new MemoryPage(0xA000, size)));
+    }
+}
+
+std::unique_ptr<MemoryPage>& MBC5::GetPage(u16 address)
+{
+    if(address >= 0xA000 && address <= 0xBFFF) {
+        if(!extRamEnabled || ramBank >= ramBanks.size())
+            throw std::out_of_range("Cartridge RAM not mapped!");
+        return ramBanks[ramBank];
+    }
+
+    return MBC::GetPage(address);
+}
+
+void MBC5::Write8(u16 address, u8 data)
+{
+    if(address >= 0x0000 && address <= 0x1FFF)
+    {
+        extRamEnabled = (data & 0x0F) == 0x0A;
+        MapBanks();
+        return;
+    }
+    if(address >= 0x2000 && address <= 0x2FFF)
+    {
+        // low 8 bits of the ROM bank
+        romBank = (romBank & 0x100) | data;
+        MapBanks();
+        return;
+    }
+    if(address >= 0x3000 && address <= 0x3FFF)
+    {
+        // 9th bit of the ROM bank
+        romBank = (romBank & 0x0FF) | ((data & 0x01) << 8);
+        MapBanks();
+        return;
+    }
+    if(address >= 0x4000 && address <= 0x5FFF)
+    {
+        ramBank = data & ((hasRumble)? 0x07 : 0x0F);
+        MapBanks();
+        return;
+    }
+    MBC::Write8(address, data);
+}
+
+}; // namespace Memory
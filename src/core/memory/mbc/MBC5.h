@@ -0,0 +1,52 @@
+// Copyright (C) 2017 Ryan Terry
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+#include "MBC.h"
+
+
+namespace Memory {
+
+class MBC5
+: public MBC
+{
+protected:
+    // 9-bit ROM bank, bank 0 is selectable
+    u16 romBank;
+    u8 ramBank;
+    bool extRamEnabled;
+    // Rumble carts use RAM bank bit 3 for the motor
+    bool hasRumble;
+    // Only as many 8KB banks as the header asks for
+    std::vector<std::unique_ptr<MemoryPage>> ramBanks;
+
+public:
+    MBC5(Core::GameBoy* gameboy);
+    virtual void Load(std::unique_ptr<Core::Rom>& rom);
+
+    // throws std::out_of_range if the RAM is
+    // disabled or the bank isn't there
+    virtual std::unique_ptr<MemoryPage>& GetPage(u16 address);
+    // bank numbers past the end of the ROM wrap around,
+    // like the unconnected address lines on the cart
+    virtual int GetRomBank()
+        { return romBank % numRomBanks; }
+    virtual int GetRamBank()
+        { return ramBank; }
+
+    virtual void Write8(u16 address, u8 data);
+};
+
+}; // namespace Memory
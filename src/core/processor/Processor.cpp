@@ -27,6 +27,15 @@ namespace Core {
 Processor::Processor(GameBoy* gameboy,
                      std::shared_ptr<Memory::MemoryBus>& memory_bus)
 :
+    reg_PC (),
+    reg_SP (),
+    reg_AF (),
+    reg_BC (),
+    reg_DE (),
+    reg_HL (),
+    instructionPC (0),
+    IE (0),
+    IF (0),
     gameboy (gameboy),
     memory_bus (memory_bus)
 {
@@ -43,6 +52,9 @@ int Processor::Tick()
     int new_cycles = ExecuteNext();
     new_cycles += TickInterrupts();
 
+    if(dmaCycles > 0)
+        TickDMA(new_cycles);
+
     return new_cycles;
 }
 
@@ -117,24 +129,39 @@ void Processor::StartDMATransfer(u8 addrH)
     // This allows for 0x100 increments
     // Data is transfered in 40*4 bytes
     // chunks to OAM
-    u16 address = addrH << 8;
-    const int totalBytes = 40*4;
-    for(int i = 0; i < totalBytes; i++)
-        memory_bus->Write8(0xFE00+i, memory_bus->Read8(address+i));
+    // A restarted transfer reads its source
+    // from the bus, not the locked out CPU
+    if(dmaCycles > 0)
+        memory_bus->LockDMA(false);
+    memory_bus->TransferOAM(addrH);
+
+    // Schedule the end of the transfer; until then
+    // the CPU is locked out of everything but IO and HRAM
+    dmaCycles = DMA_CYCLES;
+    memory_bus->LockDMA(true);
+}
 
-    // TODO: cycle accuracy
+void Processor::TickDMA(int cycles)
+{
+    dmaCycles -= cycles;
+    if(dmaCycles <= 0)
+    {
+        dmaCycles = 0;
+        memory_bus->LockDMA(false);
+    }
 }
 
 // fetches operand and increments PC
 // TODO: inline these
 u8 Processor::GetOperand8()
 {
-    return memory_bus->Read8(reg_PC.word++);
+    return memory_bus->Fetch8(reg_PC.word++);
 }
 
 u16 Processor::GetOperand16()
 {
-    u16 operand = memory_bus->Read16(reg_PC.word);
+    u16 operand = memory_bus->Fetch8(reg_PC.word) |
+                  (memory_bus->Fetch8(reg_PC.word + 1) << 8);
     reg_PC.word += 2;
     return operand;
 }
@@ -142,7 +169,8 @@ u16 Processor::GetOperand16()
 // Decodes and executes instruction
 int Processor::ExecuteNext()
 {
-    u8 opcode = memory_bus->Read8(reg_PC.word++);
+    instructionPC = reg_PC.word;
+    u8 opcode = memory_bus->Fetch8(reg_PC.word++);
     bool branch_taken = false;
     // the table to look for opcode information in
     const Opcode* opcode_lookup_table = OPCODE_LOOKUP;
@@ -819,13 +847,17 @@ int Processor::ExecuteNext()
             gameboy->Stop();
     }
 
-    return (!branch_taken)?
-        opcode_lookup_table[opcode].cycles : opcode_lookup_table[opcode].cycles_branch;
+    // cycles_branch isn't filled in yet, and cycles already
+    // holds what a taken branch costs, so don't let a taken
+    // branch cost nothing
+    const Opcode& info = opcode_lookup_table[opcode];
+    return (branch_taken && info.cycles_branch != 0)?
+        info.cycles_branch : info.cycles;
 }
 
 u8 Processor::ExecuteCBOpcode()
 {
-    u8 opcode = memory_bus->Read8(reg_PC.word++);
+    u8 opcode = memory_bus->Fetch8(reg_PC.word++);
 
     switch(opcode)
     {
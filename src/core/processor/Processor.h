@@ -69,12 +69,21 @@ class Processor
     inline bool HalfCarry() {               return ((reg_F & 0x20) != 0x00); }
     inline bool Carry() {                   return ((reg_F & 0x10) != 0x00); }
 
+    // Address of the instruction being executed
+    u16 instructionPC;
+
     // Interrupt registers
     bool IME;
     u8 IE;
     u8 IF;
     int TickInterrupts();
 
+    // OAM DMA takes 160 machine cycles, the bus is
+    // released once this many cycles have passed
+    static const int DMA_CYCLES = 160*4;
+    int dmaCycles = 0;
+    void TickDMA(int cycles);
+
     GameBoy* gameboy;
     std::shared_ptr<Memory::MemoryBus> memory_bus;
 
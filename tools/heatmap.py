@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+# Copyright (C) 2017 Ryan Terry
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Turns a heatmap dumped with --heatmap=<file> into a PNG.
+#
+# Usage: heatmap.py <heatmap file> <output png>
+#
+# The image has one panel each for reads, writes and instruction
+# fetches. Each panel row is 1 KB of the address space (64 granules
+# of 16 bytes), so 0x0000 is the top left and 0xFFFF the bottom right.
+# A per-region and per-bank summary is printed to stdout.
+
+import math
+import struct
+import sys
+import zlib
+
+TYPES = ["reads", "writes", "fetches"]
+REGIONS = [
+    ("ROM0", 0x0000, 0x3FFF),
+    ("ROMX", 0x4000, 0x7FFF),
+    ("VRAM", 0x8000, 0x9FFF),
+    ("SRAM", 0xA000, 0xBFFF),
+    ("WRAM", 0xC000, 0xDFFF),
+    ("ECHO", 0xE000, 0xFDFF),
+    ("OAM",  0xFE00, 0xFEFF),
+    ("IO",   0xFF00, 0xFF7F),
+    ("HRAM", 0xFF80, 0xFFFF),
+]
+CELL = 4
+COLUMNS = 64
+GAP = 8
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"JXHM":
+        raise SystemExit("Not a JaxBoy heatmap file!")
+    version, granules, rom_banks, ram_banks = struct.unpack_from("<4I", data, 4)
+    if version != 1:
+        raise SystemExit("Unknown heatmap version " + str(version))
+    offset = 20
+
+    def table(count):
+        nonlocal offset
+        rows = []
+        for _ in TYPES:
+            rows.append(struct.unpack_from("<%dQ" % count, data, offset))
+            offset += count * 8
+        return rows
+
+    return granules, table(granules), table(rom_banks), table(ram_banks)
+
+
+def heat(value, peak):
+    # log scale, black -> red -> yellow -> white
+    if value == 0:
+        return (0, 0, 0)
+    t = math.log1p(value) / math.log1p(peak)
+    return (int(min(1.0, t * 3) * 255),
+            int(min(1.0, max(0.0, t * 3 - 1)) * 255),
+            int(min(1.0, max(0.0, t * 3 - 2)) * 255))
+
+
+def write_png(path, width, height, pixels):
+    def chunk(tag, body):
+        return (struct.pack(">I", len(body)) + tag + body +
+                struct.pack(">I", zlib.crc32(tag + body) & 0xFFFFFFFF))
+
+    raw = b"".join(b"\x00" + bytes(pixels[y * width * 3:(y + 1) * width * 3])
+                   for y in range(height))
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(raw, 9)))
+        f.write(chunk(b"IEND", b""))
+
+
+def main():
+    if len(sys.argv) != 3:
+        raise SystemExit("Usage: heatmap.py <heatmap file> <output png>")
+
+    granules, counts, rom_banks, ram_banks = load(sys.argv[1])
+    rows = granules // COLUMNS
+    panel_w = COLUMNS * CELL
+    width = panel_w * len(TYPES) + GAP * (len(TYPES) - 1)
+    height = rows * CELL
+    pixels = bytearray(width * height * 3)
+
+    for panel, values in enumerate(counts):
+        peak = max(values) or 1
+        left = panel * (panel_w + GAP)
+        for g, value in enumerate(values):
+            color = heat(value, peak)
+            gx = left + (g % COLUMNS) * CELL
+            gy = (g // COLUMNS) * CELL
+            for y in range(gy, gy + CELL):
+                for x in range(gx, gx + CELL):
+                    i = (y * width + x) * 3
+                    pixels[i:i + 3] = bytes(color)
+
+    write_png(sys.argv[2], width, height, pixels)
+
+    granule_size = 0x10000 // granules
+    total = sum(sum(values) for values in counts) or 1
+    print("%-6s %14s %14s %14s %7s" % ("region", *TYPES, "share"))
+    for name, start, end in REGIONS:
+        sums = [sum(values[start // granule_size:end // granule_size + 1])
+                for values in counts]
+        print("%-6s %14d %14d %14d %6.2f%%" % (name, *sums, 100.0 * sum(sums) / total))
+
+    for label, table in (("ROM bank", rom_banks), ("RAM bank", ram_banks)):
+        for bank in range(len(table[0])):
+            sums = [values[bank] for values in table]
+            if any(sums):
+                print("%s %3d: %14d %14d %14d" % (label, bank, *sums))
+
+
+if __name__ == "__main__":
+    main()